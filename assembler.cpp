@@ -0,0 +1,145 @@
+#include "assembler.h"
+#include "thread_pool.h"
+#include <exception>
+#include <thread>
+
+void SICXEAssembler::assemble(const string& inputFile, const string& listingFile, const string& objectFile,
+                              ObjectFormat format) {
+    reset();
+    
+    // Progress goes to stdout, or nowhere in batch mode
+    ostream log(batchMode ? nullptr : cout.rdbuf());
+    log << "Starting SIC-XE Assembly Process..." << endl;
+    log << "Input file: " << inputFile << endl;
+    
+    if (!source.open(inputFile)) {
+        throw AssemblyError("Error: Cannot open source file " + inputFile + "\n");
+    }
+    if (fetchFromCache(listingFile, objectFile, format, log)) return;
+    
+    // Parse source file
+    log << "Parsing source file..." << endl;
+    parseSource();
+    assembleParsed(listingFile, objectFile, format, log);
+}
+
+void SICXEAssembler::assembleSource(string_view text, const string& listingFile, const string& objectFile,
+                                    ObjectFormat format) {
+    reset();
+    
+    ostream log(batchMode ? nullptr : cout.rdbuf());
+    log << "Starting SIC-XE Assembly Process..." << endl;
+    source.assign(text);
+    if (fetchFromCache(listingFile, objectFile, format, log)) return;
+    log << "Parsing source..." << endl;
+    parseSource();
+    assembleParsed(listingFile, objectFile, format, log);
+}
+
+// Both passes and the output files, once the source is parsed
+void SICXEAssembler::assembleParsed(const string& listingFile, const string& objectFile, ObjectFormat format,
+                                    ostream& log) {
+    log << "Parsed " << sourceLines.size() << " lines." << endl;
+    
+    // Pass 1
+    log << "Starting Pass 1..." << endl;
+    pass1();
+    log << "Pass 1 completed. Found " << symbolTable.size() << " symbols." << endl;
+    log << "Control sections: " << controlSections.size() << endl;
+    assemblePass2(listingFile, objectFile, format, log);
+}
+
+// Pass 2 and the output files, once pass 1's state is in place
+void SICXEAssembler::assemblePass2(const string& listingFile, const string& objectFile, ObjectFormat format,
+                                   ostream& log) {
+    // Pass 2
+    log << "Starting Pass 2..." << endl;
+    pass2();
+    log << "Pass 2 completed. Generated object codes." << endl;
+    
+    // Generate output files. The listing (if any) is formatted and written
+    // on its own thread while the object file is produced here.
+    log << "Generating output files..." << endl;
+    bool listingWritten = false;
+    exception_ptr listingError;
+    auto writeListing = [&] {
+        try {
+            listingWritten = generateListingFile(listingFile);
+        } catch (...) {
+            listingError = current_exception();
+        }
+    };
+    thread listingWriter;
+    if (!listingFile.empty()) {
+        if (batchMode) {
+            writeListing();
+        } else {
+            listingWriter = thread(writeListing);
+        }
+    }
+    bool objectWritten = generateObjectFile(objectFile, format);
+    if (listingWriter.joinable()) listingWriter.join();
+    if (listingError) rethrow_exception(listingError);
+    
+    checkOutputs(listingFile, listingWritten, objectFile, objectWritten, log);
+    if (buildCache && !cacheKey.empty()) storeInCache(!listingFile.empty());
+    log << "Assembly completed successfully!" << endl;
+}
+
+// Throws for the output files that could not be written
+void SICXEAssembler::checkOutputs(const string& listingFile, bool listingWritten, const string& objectFile,
+                                  bool objectWritten, ostream& log) {
+    string errors;
+    if (!listingFile.empty()) {
+        if (listingWritten) {
+            log << "Listing file generated: " << listingFile << endl;
+        } else {
+            errors += "Error: Cannot create listing file " + listingFile + "\n";
+        }
+    }
+    if (objectWritten) {
+        log << "Object file generated: " << objectFile << endl;
+    } else {
+        errors += "Error: Cannot create object file " + objectFile + "\n";
+    }
+    if (!errors.empty()) throw AssemblyError(errors);
+}
+
+// Everything one assembly leaves behind, down to the views into its source.
+// Containers keep their capacity, and the instruction table is static, so
+// the next assembly starts without rebuilding anything.
+void SICXEAssembler::reset() {
+    if (incremental) keepSections();
+    clearPass1();
+    source.close();
+    sourceLines.clear();
+    modificationRecords.clear();
+    textRecords.clear();
+    objectBytes.clear();
+    resolvedSymbols.clear();
+    sectionScopes.clear();
+    baseStates.clear();
+    listingOutput.clear();
+    objectOutput.clear();
+    fromCache = false;
+    cacheKey.clear();
+    cachedTables = CachedModule();
+}
+
+void SICXEAssembler::assembleSource(string_view text, AssemblyResult& result, const AssemblyOptions& options) {
+    reset();
+    source.assign(text);
+    parseSource();
+    pass1();
+    pass2();
+    
+    buildObjectModule(result.module);
+    formatObjectFile(result.module, options.format);
+    objectOutput.copyTo(result.object);
+    result.listing.clear();
+    if (options.listing) {
+        formatListing();
+        listingOutput.copyTo(result.listing);
+    }
+    result.symbols.assign(symbolTable.begin(), symbolTable.end());
+}
@@ -4,29 +4,242 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
 
 using namespace std;
 
+// A diagnostic that stops the assembly of a module. what() is the message
+// exactly as it is reported: one or more lines, each ending in a newline.
+class AssemblyError : public runtime_error {
+public:
+    explicit AssemblyError(const string& message) : runtime_error(message) {}
+};
+
+// SIC/XE addresses are 20 bits: every address is below this, and a program
+// must end at or before it
+const int MEMORY_SIZE = 1 << 20;
+
+// Source text of the program being assembled. The file is mapped once
+// (private, copy-on-write) and every parsed field is a view into it; input
+// that cannot be mapped (pipes, empty files) is read into an owned buffer.
+class SourceBuffer {
+private:
+    char* mapped;
+    size_t mappedSize;
+    vector<char> owned;
+    
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    
+public:
+    SourceBuffer() : mapped(nullptr), mappedSize(0) {}
+    ~SourceBuffer() { close(); }
+    bool open(const string& filename);
+    void assign(string_view text);   // a copy of text held in memory
+    void close();
+    char* data() { return mapped ? mapped : owned.data(); }
+    size_t size() const { return mapped ? mappedSize : owned.size(); }
+};
+
+// Output file formatted in memory. Text goes into large blocks that are
+// kept for the next file, and the finished file is handed to the kernel
+// with writev() instead of one write per flushed line.
+class OutputBuffer {
+private:
+    struct Block {
+        unique_ptr<char[]> data;
+        size_t capacity;
+        size_t length;
+    };
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+    
+    vector<Block> blocks;
+    size_t active;   // blocks in use; the last one is being filled
+    char* cursor;
+    char* limit;
+    
+    void nextBlock(size_t minimum);
+    void finish();
+    
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+    
+public:
+    OutputBuffer() : active(0), cursor(nullptr), limit(nullptr) {}
+    
+    // Room for exactly 'count' bytes, to be filled by the caller
+    char* reserve(size_t count) {
+        if (size_t(limit - cursor) < count) nextBlock(count);
+        char* out = cursor;
+        cursor += count;
+        return out;
+    }
+    OutputBuffer& operator<<(string_view text) {
+        if (text.empty()) return *this;   // its data() may be null
+        memcpy(reserve(text.size()), text.data(), text.size());
+        return *this;
+    }
+    OutputBuffer& operator<<(char c) {
+        *reserve(1) = c;
+        return *this;
+    }
+    
+    // The equivalents of 'setw(width) << left << text', of
+    // 'setw(width) << value' and of intToHex(value, width)
+    void pad(string_view text, size_t width);
+    void number(int value, int width, bool leftAlign = false);
+    void hex(int value, int width);
+    
+    size_t size() const;
+    void append(OutputBuffer& other);   // moves other's contents to the end
+    void copyTo(string& out);           // replaces out's contents
+    void clear();
+    bool writeTo(const string& filename);
+};
+
+// One source line split into fields by FieldScanner
+struct LineFields {
+    static const int MAX_FIELDS = 4;
+    string_view line;                 // the line without its '\n'
+    string_view field[MAX_FIELDS];    // trimmed fields, empty when absent
+    string_view tail[MAX_FIELDS];     // comment text starting at field i
+    int count;
+    int commentField;                 // field where a '.' comment starts, or MAX_FIELDS
+    
+    LineFields() : count(0), commentField(MAX_FIELDS) {}
+};
+
+// Vectorized line/field scanner. Each window of the source is classified
+// into newline, tab, space and quote/dot bitmasks 16 (SSE2) or 32 (AVX2)
+// bytes at a time, then lines and fields are cut by walking the set bits.
+// Lines containing a tab are split on tabs exactly like split(line, '\t');
+// other lines are read in the space-aligned column format.
+class FieldScanner {
+public:
+    enum Mode { AUTO, SCALAR, SSE2, AVX2 };
+    typedef void (*Classifier)(const char* text, size_t length, uint64_t* newline,
+                               uint64_t* tab, uint64_t* space, uint64_t* mark);
+    static constexpr size_t WINDOW = 4096;
+    
+    FieldScanner(const char* text, size_t length, Mode mode = AUTO);
+    bool next(LineFields& fields);
+    static const char* modeName(Mode mode);
+    
+private:
+    const char* text;
+    size_t length;
+    size_t position;
+    size_t windowStart;
+    size_t windowLength;
+    Classifier classify;
+    uint64_t newlineMask[WINDOW / 64];
+    uint64_t tabMask[WINDOW / 64];
+    uint64_t spaceMask[WINDOW / 64];
+    uint64_t markMask[WINDOW / 64];
+    
+    void walkLine(LineFields& fields, size_t begin, size_t end, const uint64_t* tab,
+                  const uint64_t* space, const uint64_t* mark, size_t maskBase);
+};
+
+// Every mnemonic the assembler knows: SIC/XE instructions and directives
+enum class Opcode : uint8_t {
+    NONE,
+    // Format 1
+    FIX, FLOAT, HIO, NORM, SIO, TIO,
+    // Format 2
+    ADDR, CLEAR, COMPR, DIVR, MULR, RMO, SHIFTL, SHIFTR, SUBR, SVC, TIXR,
+    // Format 3/4
+    ADD, ADDF, AND, COMP, COMPF, DIV, DIVF, J, JEQ, JGT, JLT, JSUB,
+    LDA, LDB, LDCH, LDF, LDL, LDS, LDT, LDX, LPS, MUL, MULF, OR, RD, RSUB, SSK,
+    STA, STB, STCH, STF, STI, STL, STS, STSW, STT, STX, SUB, SUBF, TD, TIX, WD,
+    // Directives
+    START, END, RESW, RESB, WORD, BYTE, CSECT, EXTDEF, EXTREF,
+    BASE, NOBASE, EQU, ORG, LTORG, USE
+};
+
+// Structure for instruction information
+// Entries live in a static compile-time table (instruction_table.cpp);
+// directives have format 0 and machine code 0.
+struct Instruction {
+    string_view opcode;
+    int format;
+    uint8_t machineCode;  // opcode byte
+    Opcode code;
+    
+    constexpr Instruction(string_view op, int fmt, uint8_t mc, Opcode c)
+        : opcode(op), format(fmt), machineCode(mc), code(c) {}
+    constexpr bool isDirective() const { return format == 0; }
+};
+
+// Perfect-hash lookup of an upper-case mnemonic; nullptr if unknown
+const Instruction* findInstruction(string_view mnemonic);
+
+// Table-driven hex codec (utils.cpp); none of these allocate
+int hexDigitValue(char c);                                     // -1 if not a hex digit
+char* formatHex(char* out, uint32_t value, int width);         // returns end of digits
+void encodeHex(const uint8_t* bytes, size_t length, char* out);  // 2 * length digits
+
+// 64-bit hash of a byte string (utils.cpp); not cryptographic
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Operand field decoded once in pass 1 (decodeOperand) so that pass 2
+// works from flags, ids and numbers instead of re-parsing the text
+struct Operand {
+    string_view name;      // operand without '#'/'@' and ",X" (as written for WORD/BASE)
+    int symbol;            // interned id of 'name', -1 if the line was not decoded
+    int value;             // numeric value of 'name' when isConstant
+    bool isConstant;       // 'name' reads as a decimal number
+    bool isRegister;       // 'name' is a register mnemonic
+    bool immediate;        // '#'
+    bool indirect;         // '@'
+    bool indexed;          // ",X"
+    bool literal;          // '='
+    bool validRegisters;   // format 2: every comma-separated token is a register
+    int8_t registers[2];   // format 2 register numbers, -1 if missing or invalid
+    
+    Operand() : symbol(-1), value(0), isConstant(false), isRegister(false), immediate(false),
+                indirect(false), indexed(false), literal(false), validRegisters(false),
+                registers{-1, -1} {}
+};
+
 // Structure to represent a line of assembly code
+// Text fields are views into the SourceBuffer (or into assembler-owned
+// storage for synthesized lines) and stay valid for the whole assembly.
 struct AssemblyLine {
     int lineNumber;
-    string label;
-    string opcode;
-    string operand;
-    string comment;
+    string_view label;
+    string_view opcode;
+    string_view operand;
+    string_view comment;
     int address;
-    string objectCode;
+    int codeOffset;                  // object code: bytes [codeOffset, codeOffset + codeLength)
+    int codeLength;                  // of objectBytes[section + 1]; 0 when the line has none
     bool isComment;
-    string controlSection;
+    string_view controlSection;
+    int section;                     // index into controlSections, -1 outside any section
+    int baseState;                   // index into baseStates: the base register pass 2 encodes with
+    
+    // Decoded once from 'opcode' by decodeOpcode()
+    Opcode op;                       // NONE when empty or unknown
+    const Instruction* instruction;  // static table entry, null when op is NONE
+    bool extended;                   // '+' prefix (format 4)
+    Operand decodedOperand;
     
-    AssemblyLine() : lineNumber(0), address(0), isComment(false), controlSection("") {}
+    AssemblyLine() : lineNumber(0), address(0), codeOffset(0), codeLength(0), isComment(false), section(-1),
+                     baseState(0), op(Opcode::NONE), instruction(nullptr), extended(false) {}
 };
 
 // Structure for symbol table entry
@@ -37,18 +250,18 @@ struct Symbol {
     bool isDefined;
     
     Symbol() : address(0), controlSection(""), isExternal(false), isDefined(false) {}
-    Symbol(int addr, string cs, bool ext = false, bool def = true) 
+    Symbol(int addr, string_view cs, bool ext = false, bool def = true) 
         : address(addr), controlSection(cs), isExternal(ext), isDefined(def) {}
 };
 
-// Structure for instruction information
-struct Instruction {
-    string opcode;
-    int format;
-    string machineCode;
+// Literal pool placed by an LTORG or END: entries [first, last) of
+// literalLines, listed right after sourceLines[line]
+struct LiteralPool {
+    size_t line;
+    size_t first;
+    size_t last;
     
-    Instruction() : opcode(""), format(0), machineCode("") {}
-    Instruction(string op, int fmt, string mc) : opcode(op), format(fmt), machineCode(mc) {}
+    LiteralPool(size_t l, size_t f, size_t e) : line(l), first(f), last(e) {}
 };
 
 // Structure for control section information
@@ -57,10 +270,13 @@ struct ControlSection {
     int startAddress;
     int length;
     vector<string> extDef;
-    vector<string> extRef;
+    vector<string> extRef;                // declaration order, for the R record
+    unordered_set<string_view> extRefSet; // same names, for membership tests
     
     ControlSection() : name(""), startAddress(0), length(0) {}
-    ControlSection(string n, int start) : name(n), startAddress(start), length(0) {}
+    ControlSection(string_view n, int start) : name(n), startAddress(start), length(0) {}
+    
+    bool refersTo(string_view symbol) const { return extRefSet.count(symbol) != 0; }
 };
 
 // Structure for modification record
@@ -68,91 +284,441 @@ struct ModificationRecord {
     int address;
     int length;
     string symbol;
+    int section;      // index of the control section that produced it
     bool isAddition;
     
-    ModificationRecord(int addr, int len, string sym, bool add = true) 
-        : address(addr), length(len), symbol(sym), isAddition(add) {}
+    ModificationRecord(int addr, int len, string_view sym, int sect, bool add = true) 
+        : address(addr), length(len), symbol(sym), section(sect), isAddition(add) {}
 };
 
 // Structure for text record
+// The record's bytes are contiguous in its section's objectBytes buffer;
+// pieces holds the length of each line's object code, for the '^' breaks
 struct TextRecord {
     int startAddress;
-    vector<string> objectCodes;
-    string controlSection;
+    int offset;
+    int length;
+    vector<int> pieces;
+    
+    TextRecord(int start, int off = 0) : startAddress(start), offset(off), length(0) {}
+};
+
+// Base register as pass 2 sees it: BASE directives load it as they are
+// reached, starting from the state pass 1 ended with (NOBASE only matters
+// in pass 1)
+struct BaseState {
+    int address;
+    bool set;
+    
+    BaseState(int addr = 0, bool s = false) : address(addr), set(s) {}
+};
+
+// Kept by each chunk of a parallel pass 1: what the merge needs to check
+// that the chunk saw the symbol table a serial pass would have (pass1.cpp)
+struct Pass1Trace {
+    vector<string_view> earlyLookups;  // looked up before the chunk itself defined them
+    // First definition of each name: by a label (not EQU)?, in which section
+    unordered_map<string_view, pair<bool, string_view>> definitions;
+    bool setsBase;                     // ran a BASE with an operand, or a NOBASE
     
-    TextRecord(int start, string cs = "") : startAddress(start), controlSection(cs) {}
+    Pass1Trace() : setsBase(false) {}
+};
+
+// A symbol table entry one control section's object code was built with
+struct SectionDependency {
+    string name;
+    bool found;
+    int address;
+    bool isExternal;
+    
+    SectionDependency(string_view n, const Symbol* symbol)
+        : name(n), found(symbol != nullptr), address(symbol ? symbol->address : 0),
+          isExternal(symbol && symbol->isExternal) {}
+};
+
+// What pass 2 produced for one group of lines (a control section, or the
+// lines before START), kept for incremental reassembly (incremental.cpp)
+struct CachedSection {
+    uint64_t fingerprint;                     // source text and pass 1 layout
+    bool cacheable;                           // every line belongs to the section
+    bool complete;                            // pass 2 finished it
+    vector<SectionDependency> dependencies;   // every name its operands look up
+    vector<pair<int, int>> spans;             // codeOffset, codeLength of each line (forEachLine order)
+    vector<uint8_t> code;
+    vector<TextRecord> texts;
+    vector<ModificationRecord> modifications;
+    
+    CachedSection() : fingerprint(0), cacheable(false), complete(false) {}
+};
+
+// One control section of an object program, in the form both object file
+// formats are written from and read back into
+struct ObjectSection {
+    string name;
+    int startAddress;
+    int length;
+    vector<pair<string, int>> definitions;    // D record
+    vector<string> references;                // R record
+    vector<TextRecord> texts;                 // offsets into 'code'
+    vector<ModificationRecord> modifications;
+    vector<uint8_t> code;
+    bool hasEntry;                            // E record has an address
+    int entryAddress;
+    
+    ObjectSection() : startAddress(0), length(0), hasEntry(false), entryAddress(0) {}
+};
+
+struct ObjectModule {
+    vector<ObjectSection> sections;
+};
+
+enum class ObjectFormat { TEXT, BINARY };
+
+// In-memory assembly (SICXEAssembler::assembleSource)
+struct AssemblyOptions {
+    ObjectFormat format;
+    bool listing;    // also produce the listing
+    
+    AssemblyOptions() : format(ObjectFormat::TEXT), listing(true) {}
+};
+
+// The outputs of one assembly; a result that is reused keeps the capacity
+// of its strings from one assembly to the next
+struct AssemblyResult {
+    string object;                          // the object file, in the requested format
+    string listing;                         // the listing file, empty if not requested
+    vector<pair<string, Symbol>> symbols;   // the symbol table, by name
+    ObjectModule module;                    // control sections with their records and code
+};
+
+// Object file formats (object_format.cpp). The text format is the
+// H^/D^/R^/T^/M^/E records; the binary layout is in object_format.h.
+// The readers reject addresses of MEMORY_SIZE or more and longer lengths,
+// report problems on log (cerr by default) and return false.
+void writeObjectText(const ObjectModule& module, OutputBuffer& out);
+void writeObjectBinary(const ObjectModule& module, OutputBuffer& out);
+bool isBinaryObject(const char* data, size_t size);
+bool readObjectText(string_view text, ObjectModule& module, ostream& log = cerr);
+bool readObjectBinary(const char* data, size_t size, ObjectModule& module, ostream& log = cerr);
+
+// Linking loader (linker.cpp). Control sections are loaded one after the
+// other from the load address, module by module in the order given. ESTAB
+// maps every section name and D record symbol to its loaded address; M
+// records then add or subtract those into the memory image. Addresses in
+// a section's records are relative to its H record start address.
+// Problems are reported on cerr and make the functions return false.
+struct LoadedSection {
+    string name;
+    size_t module;                       // index of the module it came from
+    size_t section;                      // index within that module
+    int address;                         // loaded address
+    int length;                          // H record length, or to the end of its last T record
+    vector<pair<string, int>> symbols;   // its D record symbols, loaded addresses
+};
+
+struct LoadImage {
+    int loadAddress;
+    int entryAddress;                    // first E record with an address, else loadAddress
+    vector<uint8_t> memory;              // from loadAddress on
+    vector<LoadedSection> sections;      // in load order
+    unordered_map<string_view, int> estab;   // names are views into the modules
+
+    LoadImage() : loadAddress(0), entryAddress(0) {}
+};
+
+// Pass 1: section addresses and ESTAB
+bool placeSections(const vector<ObjectModule>& modules, int loadAddress, LoadImage& image);
+// Pass 2: T records into the image and M records applied, one task per
+// section on the shared pool (sections never overlap)
+bool relocateSections(const vector<ObjectModule>& modules, LoadImage& image);
+void writeLoadMap(const LoadImage& image, const vector<string>& moduleNames, OutputBuffer& out);
+
+// What the build cache keeps of one assembly: the output files, and the
+// tables the assembler prints on request
+struct CachedModule {
+    string object;
+    string listing;    // empty when the listing was not requested
+    string symbols;    // printSymbolTable()'s output
+    string sections;   // printControlSections()'s output
+};
+
+// On-disk cache of assembled modules (build_cache.cpp), safe to share
+// between threads, processes and builds. An entry is one file named after
+// a hash of the source, the assembler version and the options that change
+// the output; it is written under a temporary name and renamed into place.
+// Once the directory grows past maxBytes the least recently used entries
+// are removed.
+class BuildCache {
+private:
+    string directory;
+    uint64_t maxBytes;
+    atomic<uint64_t> estimatedBytes;   // as of the last trim, plus what this process stored since
+
+    string entryPath(const string& key) const { return directory + "/" + key + ".sxc"; }
+
+public:
+    BuildCache(const string& directory, uint64_t maxBytes);
+    bool open();   // creates the directory if needed; false with errno set
+    static string key(string_view source, ObjectFormat format, bool listing);
+    bool fetch(const string& key, CachedModule& module);   // also marks it as used
+    void store(const string& key, const CachedModule& module);
+    void trim();   // also measures the directory for estimatedBytes
 };
 
 class SICXEAssembler {
 private:
     // Data structures
+    SourceBuffer source;
+    OutputBuffer listingOutput;      // the listing and object files are written
+    OutputBuffer objectOutput;       // concurrently, each from its own buffer
+    bool batchMode;
     vector<AssemblyLine> sourceLines;
-    map<string, Symbol> symbolTable;
-    map<string, Instruction> instructionTable;
+    map<string, Symbol, less<>> symbolTable;
     vector<ControlSection> controlSections;
-    vector<ModificationRecord> modificationRecords;
-    vector<TextRecord> textRecords;
-    map<string, int> literalTable;  // literal -> address
-    vector<string> pendingLiterals; // literals waiting for LTORG
-    map<int, vector<string>> ltorgLiterals; // LTORG line number -> literals to place
+    vector<vector<ModificationRecord>> modificationRecords;  // per section, sorted by address
+    vector<vector<TextRecord>> textRecords;  // per section, in address order
+    vector<vector<uint8_t>> objectBytes;     // object code, per section + 1 (0 = outside any section)
+    unordered_map<string_view, int> literalTable;  // literal -> address
+    vector<string_view> pendingLiterals;           // literals waiting for LTORG, in first-use order
+    unordered_set<string_view> pendingLiteralSet;  // same literals, for duplicate checks
+    vector<AssemblyLine> literalLines;             // pool entries ("*" lines), pool by pool
+    vector<LiteralPool> literalPools;              // where each pool is listed, in program order
+    unordered_map<string_view, int> symbolIds;   // operand name -> interned id
+    vector<string_view> symbolNames;             // interned id -> operand name
+    vector<const Symbol*> resolvedSymbols;       // interned id -> symbol table entry (pass 2)
+    // Labels visible in each section, keyed by interned id; index is
+    // section + 1 so that lines outside any section use scope 0
+    vector<unordered_map<int, int>> sectionScopes;
+    // Incremental mode: this assembly's groups (index as in objectBytes),
+    // and the earlier ones by fingerprint
+    bool incremental;
+    vector<CachedSection> sectionResults;
+    unordered_map<uint64_t, CachedSection> sectionCache;
     
     // Current state variables
-    string currentControlSection;
+    string_view currentControlSection;
+    int currentSection;                 // index of currentControlSection, -1 if none
     int locationCounter;
     int baseRegister;
     bool baseSet;
+    vector<size_t> baseLines;        // BASE directives in sourceLines, in order
+    vector<BaseState> baseStates;    // [0] pass 1's final state, [k] after baseLines[k - 1]
+    const AssemblyLine* lineOrigin;  // sourceLines.data() of the assembly pass 1 works for
+    Pass1Trace* trace;               // set while running one chunk of a parallel pass 1
     
     // Helper methods
-    void initializeInstructionTable();
-    void parseSourceFile(const string& filename);
-    AssemblyLine parseLine(const string& line, int lineNum);
-    string trim(const string& str);
-    vector<string> split(const string& str, char delimiter);
-    string toUpperCase(const string& str);
-    bool isValidSymbol(const string& symbol);
-    int hexToDecimal(const string& hex);
-    string decimalToHex(int decimal, int width = 0);
+    void decodeOpcode(AssemblyLine& line);
+    void parseSource();
+    void parseChunk(const char* text, size_t size, int firstLine, vector<AssemblyLine>& lines);
+    AssemblyLine parseLine(const LineFields& fields, int lineNum);
+    string_view trim(string_view str);
+    vector<string_view> split(string_view str, char delimiter);
+    string_view toUpperCase(string_view field);
+    bool isValidSymbol(string_view symbol);
+    bool parseDecimal(string_view text, int& value);
+    int hexToDecimal(string_view hex);
     string intToHex(int value, int width);
+    string bytesToHex(const uint8_t* bytes, size_t length);
+    const uint8_t* objectCodeOf(const AssemblyLine& line) const {
+        return objectBytes[line.section + 1].data() + line.codeOffset;
+    }
     
     // Pass 1 methods
     void pass1();
+    void clearPass1();
+    void pass1Lines(AssemblyLine* lines, size_t begin, size_t end);
+    vector<size_t> pass1Chunks();
+    bool pass1Sections(const vector<size_t>& bounds);
+    void traceLookup(string_view name);
+    void traceDefinition(string_view name, bool label);
     void processDirective(AssemblyLine& line);
     void processInstruction(AssemblyLine& line);
-    void insertLiteralLines();
-    int getInstructionSize(const string& opcode, const string& operand);
+    void placeLiteralPool(const AssemblyLine& line);
+    void decodeOperand(AssemblyLine& line);
+    int internSymbol(string_view name);
+    
+    // Visits every line in program order: the source lines, with each
+    // literal pool's entries following the LTORG or END that placed it
+    template <class Visitor>
+    void forEachLine(Visitor visit) {
+        forEachLine(0, sourceLines.size(), visit);
+    }
+    
+    // Same, for the source lines [begin, end) and the pools they place
+    template <class Visitor>
+    void forEachLine(size_t begin, size_t end, Visitor visit) {
+        size_t pool = lower_bound(literalPools.begin(), literalPools.end(), begin,
+                                  [](const LiteralPool& p, size_t line) { return p.line < line; })
+                      - literalPools.begin();
+        for (size_t i = begin; i < end; ++i) {
+            visit(sourceLines[i]);
+            for (; pool < literalPools.size() && literalPools[pool].line == i; ++pool) {
+                for (size_t entry = literalPools[pool].first; entry < literalPools[pool].last; ++entry) {
+                    visit(literalLines[entry]);
+                }
+            }
+        }
+    }
     
     // Pass 2 methods
     void pass2();
-    void validateSymbolReferences();
-    string generateObjectCode(const AssemblyLine& line);
-    string generateFormat1ObjectCode(const string& opcode);
-    string generateLiteralObjectCode(const string& literal);
-    string generateFormat2ObjectCode(const string& opcode, const string& operand);
-    string generateFormat3ObjectCode(const string& opcode, const string& operand, int address);
-    string generateFormat4ObjectCode(const string& opcode, const string& operand, int address);
+    void resolveSymbols();
+    void buildSectionScopes(const vector<size_t>& bounds, const vector<char>& encode);
+    void resolveBaseStates();
+    vector<size_t> sectionBoundaries();
+    void encodeLines(size_t begin, size_t end, vector<uint8_t>& code);
+    void finishSection(size_t group, size_t begin, size_t end);
+    void checkMemoryLimit();
+    bool isExternalOperand(const AssemblyLine& line);
+    
+    // Incremental reassembly (incremental.cpp)
+    void reuseSections(const vector<size_t>& bounds, vector<char>& encode);
+    void recordSections(const vector<size_t>& bounds, const vector<char>& encode);
+    void keepSections();
+    vector<size_t> groupTextOffsets(const vector<size_t>& bounds);
+    bool sectionFingerprint(size_t group, size_t begin, size_t end, size_t textBegin, size_t textEnd,
+                            uint64_t& fingerprint, size_t& lines);
+    const Symbol* findSymbol(string_view name);
+    bool dependenciesHold(const CachedSection& cached);
+    const Symbol* lookupSymbol(const Operand& operand);
+    void validateOperand(const AssemblyLine& line);
+    void generateObjectCode(AssemblyLine& line, vector<uint8_t>& code);
+    void encodeObjectCode(const AssemblyLine& line, vector<uint8_t>& code);
+    void encodeHexDigits(const AssemblyLine& line, string_view digits, vector<uint8_t>& code);
+    void generateFormat1ObjectCode(const Instruction& instruction, vector<uint8_t>& code);
+    void generateLiteralObjectCode(const AssemblyLine& line, vector<uint8_t>& code);
+    void generateFormat2ObjectCode(const Instruction& instruction, const Operand& operand, vector<uint8_t>& code);
+    void generateFormat3ObjectCode(const AssemblyLine& line, vector<uint8_t>& code);
+    void generateFormat4ObjectCode(const AssemblyLine& line, vector<uint8_t>& code);
     
     // Addressing mode methods
-    bool isImmediate(const string& operand);
-    bool isIndirect(const string& operand);
-    bool isIndexed(const string& operand);
-    string getBaseOperand(const string& operand);
-    int calculateTargetAddress(const string& operand, int currentAddress);
+    bool isImmediate(string_view operand);
+    bool isIndirect(string_view operand);
+    bool isIndexed(string_view operand);
+    string_view getBaseOperand(string_view operand);
+    int calculateTargetAddress(const Operand& operand, int section);
     
     // Object code generation methods
-    void generateTextRecords();
-    void generateModificationRecords();
-    bool isExternalReference(const string& symbol, const string& controlSection);
-    bool isRegisterName(const string& name);
+    void generateTextRecords(int section, size_t begin, size_t end);
+    void generateModificationRecords(size_t begin, size_t end);
+    void addModificationRecord(const ModificationRecord& record);
+    bool isExternalReference(string_view symbol, int section);
+    bool isRegisterName(string_view name);
+    int registerNumber(string_view name);
     
     // Output methods
-    void generateListingFile(const string& filename);
-    void generateObjectFile(const string& filename);
+    bool generateListingFile(const string& filename);
+    void formatListing();
+    void formatListingLines(size_t begin, size_t end, size_t firstCodeLine, OutputBuffer& file);
+    void buildObjectModule(ObjectModule& module);
+    bool generateObjectFile(const string& filename, ObjectFormat format);
+    void formatObjectFile(const ObjectModule& module, ObjectFormat format);
+    void assembleParsed(const string& listingFile, const string& objectFile, ObjectFormat format, ostream& log);
+    void assemblePass2(const string& listingFile, const string& objectFile, ObjectFormat format, ostream& log);
+    void checkOutputs(const string& listingFile, bool listingWritten, const string& objectFile, bool objectWritten,
+                      ostream& log);
+    
+    // Build cache (build_cache.cpp)
+    BuildCache* buildCache;
+    string cacheKey;      // of the source being assembled
+    bool fromCache;       // outputs and printed tables came from the cache
+    CachedModule cachedTables;
+    bool fetchFromCache(const string& listingFile, const string& objectFile, ObjectFormat format, ostream& log);
+    void storeInCache(bool listing);
+    
+    // Pass 1 state file (intermediate.cpp)
+    bool savePass1(const string& stateFile);
+    void loadPass1(const string& stateFile);
     
 public:
     SICXEAssembler();
-    void assemble(const string& inputFile, const string& listingFile, const string& objectFile);
-    void printSymbolTable();
-    void printControlSections();
+    // An empty listingFile skips the listing altogether. Errors in the
+    // source or while writing the outputs are thrown as AssemblyError.
+    void assemble(const string& inputFile, const string& listingFile, const string& objectFile,
+                  ObjectFormat format = ObjectFormat::TEXT);
+    // The same for a program held in memory, written to the same files or
+    // returned in 'result' (which prints no progress)
+    void assembleSource(string_view text, const string& listingFile, const string& objectFile,
+                        ObjectFormat format = ObjectFormat::TEXT);
+    void assembleSource(string_view text, AssemblyResult& result,
+                        const AssemblyOptions& options = AssemblyOptions());
+    // The two passes apart: assemblePass1() parses and runs pass 1 and
+    // writes its complete state to stateFile; assembleFromPass1() runs
+    // pass 2 and writes the output files from such a file, any number of
+    // times and in any format
+    void assemblePass1(const string& inputFile, const string& stateFile);
+    void assembleFromPass1(const string& stateFile, const string& listingFile, const string& objectFile,
+                           ObjectFormat format = ObjectFormat::TEXT);
+    // Drops the previous assembly; assemble() and assembleSource() start
+    // with this, so an assembler can be reused for any number of programs
+    void reset();
+    void printSymbolTable(ostream& out = cout);
+    void printControlSections(ostream& out = cout);
+    
+    // Batch mode: no progress output, and the listing is written on the
+    // calling thread (the batch already runs one module per thread)
+    void setBatchMode(bool enabled) { batchMode = enabled; }
+    
+    // Incremental mode: each assembly keeps the object code and records of
+    // its control sections, and the next one reuses those of sections whose
+    // text, layout and looked-up symbols did not change. The output is the
+    // same as without it.
+    void setIncremental(bool enabled);
+    
+    // Build cache: assemble() and the file form of assembleSource() take a
+    // module the cache has instead of assembling it, and add the ones they
+    // assemble. Null turns it off.
+    void setBuildCache(BuildCache* cache) { buildCache = cache; }
+};
+
+// Batch assembly of many modules (batch.cpp)
+struct BatchOptions {
+    ObjectFormat format;
+    bool listing;
+    size_t jobs;     // modules assembled at once
+    BuildCache* cache;   // null: no build cache
+    
+    BatchOptions() : format(ObjectFormat::TEXT), listing(true), jobs(1), cache(nullptr) {}
+};
+
+// Inputs are .asm files (outputs named after them) or @manifest files;
+// prints a per-module summary and returns the process exit status
+int runBatch(const vector<string>& inputs, const BatchOptions& options);
+
+// Assembler daemon (server.cpp). Requests and replies travel over a Unix
+// stream socket as length-prefixed messages; a connection may carry any
+// number of requests, answered in order.
+struct ServerRequest {
+    ObjectFormat format;
+    string input;          // source file; ignored for inline source
+    string listingFile;    // empty: no listing
+    string objectFile;
+    bool inlineSource;     // assemble 'source' instead of reading 'input'
+    string source;
+    
+    ServerRequest() : format(ObjectFormat::TEXT), inlineSource(false) {}
 };
 
+struct ServerReply {
+    int status;            // the exit status the command line would have
+    string diagnostics;    // what it would have printed on stderr
+    
+    ServerReply() : status(0) {}
+};
+
+// $SICXE_SOCKET, else in $XDG_RUNTIME_DIR, else in a directory of the
+// user's own in /tmp
+string defaultSocketPath();
+bool sameUser(int fd);                   // the peer runs as this process's user
+bool ownSocket(const string& path);      // a socket owned by this process's user
+bool sendRequest(int fd, const ServerRequest& request);
+bool receiveRequest(int fd, ServerRequest& request);
+bool sendReply(int fd, const ServerReply& reply);
+bool receiveReply(int fd, ServerReply& reply);
+
+// Serves requests on socketPath until SIGINT or SIGTERM, one connection per
+// shared pool worker ('jobs' of them), with the build cache if there is
+// one; returns the process exit status
+int runServer(const string& socketPath, size_t jobs, BuildCache* cache = nullptr);
+
 #endif // ASSEMBLER_H
@@ -0,0 +1,140 @@
+#include "assembler.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <numeric>
+#include <sys/stat.h>
+
+namespace {
+
+struct BatchModule {
+    string input;
+    string listing;
+    string object;
+    bool succeeded;
+    string diagnostics;   // what stopped it, when it failed
+    double seconds;
+
+    BatchModule(const string& in, const string& lst, const string& obj)
+        : input(in), listing(lst), object(obj), succeeded(false), seconds(0) {}
+};
+
+// file.asm -> file.lst, file.obj next to it
+string replaceExtension(const string& path, const char* extension) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) return path + extension;
+    return path.substr(0, dot) + extension;
+}
+
+void addModule(vector<BatchModule>& modules, const string& input) {
+    modules.emplace_back(input, replaceExtension(input, ".lst"), replaceExtension(input, ".obj"));
+}
+
+// One module per line: "<input>" or "<input> <listing> <object>"; blank
+// lines and text after '#' are ignored
+bool readManifest(const string& path, vector<BatchModule>& modules) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        cerr << "Error: Cannot open manifest " << path << endl;
+        return false;
+    }
+
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        ++lineNumber;
+        istringstream fields(line.substr(0, line.find('#')));
+        vector<string> names;
+        string name;
+        while (fields >> name) names.push_back(name);
+
+        if (names.size() == 1) {
+            addModule(modules, names[0]);
+        } else if (names.size() == 3) {
+            modules.emplace_back(names[0], names[1], names[2]);
+        } else if (!names.empty()) {
+            cerr << "Error on line " << lineNumber << " of " << path
+                 << ": expected '<input>' or '<input> <listing> <object>'" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every module gets an assembler of its own; nothing is shared between them
+void assembleModule(BatchModule& module, const BatchOptions& options) {
+    auto start = chrono::steady_clock::now();
+    try {
+        SICXEAssembler assembler;
+        assembler.setBatchMode(true);
+        assembler.setBuildCache(options.cache);
+        assembler.assemble(module.input, options.listing ? module.listing : "", module.object, options.format);
+        module.succeeded = true;
+    } catch (const AssemblyError& e) {
+        module.diagnostics = e.what();
+    } catch (const exception& e) {
+        module.diagnostics = string("Error: ") + e.what() + "\n";
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    module.seconds = elapsed.count();
+}
+
+off_t fileSize(const string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_size : 0;
+}
+
+} // namespace
+
+int runBatch(const vector<string>& inputs, const BatchOptions& options) {
+    vector<BatchModule> modules;
+    for (const string& input : inputs) {
+        if (input[0] == '@') {
+            if (!readManifest(input.substr(1), modules)) return 1;
+        } else {
+            addModule(modules, input);
+        }
+    }
+
+    // Modules are claimed from a shared counter, biggest first, so a large
+    // module never starts last and holds up the whole batch
+    vector<off_t> sizes(modules.size());
+    for (size_t i = 0; i < modules.size(); ++i) {
+        sizes[i] = fileSize(modules[i].input);
+    }
+    vector<size_t> order(modules.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    auto start = chrono::steady_clock::now();
+    if (options.jobs <= 1) {
+        for (size_t index : order) {
+            assembleModule(modules[index], options);
+        }
+    } else {
+        ThreadPool::shared().parallelFor(order.size(), [&](size_t i) {
+            assembleModule(modules[order[i]], options);
+        });
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    // Summary in input order; diagnostics go to stderr, prefixed with the module
+    size_t failed = 0;
+    for (const BatchModule& module : modules) {
+        if (module.succeeded) {
+            cout << "ok      " << module.input << " (" << fixed << setprecision(3) << module.seconds << " s)" << endl;
+            continue;
+        }
+        ++failed;
+        cout << "FAILED  " << module.input << endl;
+        istringstream lines(module.diagnostics);
+        string line;
+        while (getline(lines, line)) {
+            cerr << module.input << ": " << line << endl;
+        }
+    }
+    cout << "Assembled " << modules.size() << " modules with " << options.jobs << " jobs: "
+         << modules.size() - failed << " succeeded, " << failed << " failed ("
+         << fixed << setprecision(3) << elapsed.count() << " s)" << endl;
+    return failed == 0 ? 0 : 1;
+}
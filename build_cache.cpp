@@ -0,0 +1,250 @@
+#include "assembler.h"
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Entry file: a 4-byte tag and five 32-bit fields in host order (the cache
+// is local to the machine), then the object, listing, symbol table and
+// control section texts back to back.
+//
+//   "SXBC" version objectSize listingSize symbolsSize sectionsSize
+namespace {
+
+const char ENTRY_TAG[4] = { 'S', 'X', 'B', 'C' };
+const uint32_t ENTRY_VERSION = 1;
+const size_t ENTRY_HEADER = sizeof(ENTRY_TAG) + 5 * sizeof(uint32_t);
+
+// Part of every key. Change it whenever the output for the same source
+// changes, so that entries written by older assemblers stop matching.
+const char* const ASSEMBLER_VERSION = "sicxe-assembler 2";
+
+// Temporary files a writer left behind are removed after this long
+const time_t STALE_TEMPORARY_SECONDS = 3600;
+
+bool readAll(int fd, string& data) {
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data.append(chunk, n);
+    }
+    return true;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+uint32_t getWord(const string& data, size_t offset) {
+    uint32_t value;
+    memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+void putWord(string& data, uint32_t value) {
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+} // namespace
+
+BuildCache::BuildCache(const string& dir, uint64_t limit) : directory(dir), maxBytes(limit), estimatedBytes(0) {
+    while (directory.size() > 1 && directory.back() == '/') directory.pop_back();
+}
+
+bool BuildCache::open() {
+    // Like 'mkdir -p'
+    for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+        string prefix = directory.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0777) != 0 && errno != EEXIST) return false;
+        if (slash == string::npos) break;
+    }
+    struct stat info;
+    if (stat(directory.c_str(), &info) != 0) return false;
+    if (!S_ISDIR(info.st_mode)) {
+        errno = ENOTDIR;
+        return false;
+    }
+    if (access(directory.c_str(), R_OK | W_OK | X_OK) != 0) return false;
+    trim();
+    return true;
+}
+
+// 128 bits from two differently seeded passes; not cryptographic, so the
+// cache trusts whoever can write to its directory
+string BuildCache::key(string_view source, ObjectFormat format, bool listing) {
+    string options = ASSEMBLER_VERSION;
+    options += format == ObjectFormat::BINARY ? " binary" : " text";
+    options += listing ? " listing" : " no-listing";
+    uint64_t seed = hashBytes(options.data(), options.size());
+    uint64_t high = hashBytes(source.data(), source.size(), seed);
+    uint64_t low = hashBytes(source.data(), source.size(), ~seed);
+    char name[33];
+    snprintf(name, sizeof(name), "%016llx%016llx", (unsigned long long)high, (unsigned long long)low);
+    return name;
+}
+
+bool BuildCache::fetch(const string& key, CachedModule& module) {
+    string path = entryPath(key);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    string data;
+    bool read = readAll(fd, data);
+    // The modification time is the entry's last use, for trim()
+    if (read) futimens(fd, nullptr);
+    struct stat opened;
+    bool identified = fstat(fd, &opened) == 0;
+    close(fd);
+
+    bool valid = read && data.size() >= ENTRY_HEADER && memcmp(data.data(), ENTRY_TAG, sizeof(ENTRY_TAG)) == 0 &&
+                 getWord(data, 4) == ENTRY_VERSION;
+    uint64_t sizes[4] = {};
+    uint64_t total = ENTRY_HEADER;
+    for (int i = 0; valid && i < 4; ++i) {
+        sizes[i] = getWord(data, 8 + 4 * i);
+        total += sizes[i];
+    }
+    if (!valid || total != data.size()) {
+        // Damaged (a full disk, or written by something else); let the
+        // next assembly replace it, unless a store() already has
+        struct stat current;
+        if (read && identified && stat(path.c_str(), &current) == 0 && current.st_ino == opened.st_ino &&
+            current.st_dev == opened.st_dev) {
+            unlink(path.c_str());
+        }
+        return false;
+    }
+
+    size_t offset = ENTRY_HEADER;
+    string* parts[4] = { &module.object, &module.listing, &module.symbols, &module.sections };
+    for (int i = 0; i < 4; ++i) {
+        parts[i]->assign(data, offset, sizes[i]);
+        offset += sizes[i];
+    }
+    return true;
+}
+
+// Written to a temporary file first: readers see the whole entry or none,
+// and when two writers race, the later rename wins with the same content
+void BuildCache::store(const string& key, const CachedModule& module) {
+    const string* parts[4] = { &module.object, &module.listing, &module.symbols, &module.sections };
+    string header(ENTRY_TAG, sizeof(ENTRY_TAG));
+    putWord(header, ENTRY_VERSION);
+    uint64_t size = ENTRY_HEADER;
+    for (const string* part : parts) {
+        if (part->size() > UINT32_MAX) return;
+        putWord(header, part->size());
+        size += part->size();
+    }
+    if (size > maxBytes) return;
+
+    string temporary = directory + "/.tmp.XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0) return;
+    bool written = writeAll(fd, header.data(), header.size());
+    for (const string* part : parts) {
+        written = written && writeAll(fd, part->data(), part->size());
+    }
+    fchmod(fd, 0644);
+    if (close(fd) != 0 || !written || rename(temporary.c_str(), entryPath(key).c_str()) != 0) {
+        unlink(temporary.c_str());
+        return;
+    }
+
+    // Rather than every store scanning the directory, the directory is
+    // measured by trim() and this process's stores are counted on top; the
+    // count overestimates when an entry is replaced, which only trims early.
+    // Other processes' stores are seen at the next trim.
+    if (estimatedBytes.fetch_add(size) + size > maxBytes) trim();
+}
+
+// Removes the least recently used entries until the rest take up at most
+// three quarters of maxBytes, so that trims are not back to back
+void BuildCache::trim() {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+
+    struct Entry {
+        string path;
+        timespec used;
+        uint64_t size;
+    };
+    vector<Entry> entries;
+    uint64_t total = 0;
+    time_t now = time(nullptr);
+    while (dirent* item = readdir(dir)) {
+        string name = item->d_name;
+        string path = directory + "/" + name;
+        struct stat info;
+        bool temporary = name.compare(0, 5, ".tmp.") == 0;
+        bool entry = name.size() == 36 && name.compare(32, 4, ".sxc") == 0;
+        if ((!temporary && !entry) || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+        if (temporary) {
+            if (now - info.st_mtime > STALE_TEMPORARY_SECONDS) unlink(path.c_str());
+            continue;
+        }
+        entries.push_back(Entry{ path, info.st_mtim, uint64_t(info.st_size) });
+        total += info.st_size;
+    }
+    closedir(dir);
+    if (total <= maxBytes) {
+        estimatedBytes = total;
+        return;
+    }
+
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+        return a.used.tv_nsec < b.used.tv_nsec;
+    });
+    uint64_t target = maxBytes / 4 * 3;
+    for (const Entry& entry : entries) {
+        if (total <= target) break;
+        // Another process may have removed it first
+        unlink(entry.path.c_str());
+        total -= entry.size;
+    }
+    estimatedBytes = total;
+}
+
+// Called with the source in place and nothing parsed yet
+bool SICXEAssembler::fetchFromCache(const string& listingFile, const string& objectFile, ObjectFormat format,
+                                    ostream& log) {
+    if (!buildCache) return false;
+    cacheKey = BuildCache::key(string_view(source.data(), source.size()), format, !listingFile.empty());
+    if (!buildCache->fetch(cacheKey, cachedTables)) return false;
+    fromCache = true;
+    log << "Found in the build cache (" << cacheKey << "); skipping both passes." << endl;
+
+    listingOutput << cachedTables.listing;
+    objectOutput << cachedTables.object;
+    cachedTables.listing.clear();
+    cachedTables.object.clear();
+    bool listingWritten = !listingFile.empty() && listingOutput.writeTo(listingFile);
+    bool objectWritten = objectOutput.writeTo(objectFile);
+    checkOutputs(listingFile, listingWritten, objectFile, objectWritten, log);
+    log << "Assembly completed successfully!" << endl;
+    return true;
+}
+
+void SICXEAssembler::storeInCache(bool listing) {
+    CachedModule module;
+    objectOutput.copyTo(module.object);
+    if (listing) listingOutput.copyTo(module.listing);
+    ostringstream symbols, sections;
+    printSymbolTable(symbols);
+    printControlSections(sections);
+    module.symbols = symbols.str();
+    module.sections = sections.str();
+    buildCache->store(cacheKey, module);
+}
@@ -0,0 +1,153 @@
+// Thin front end to an assembler started with 'sicxe_assembler --serve'.
+// Takes the same arguments as the assembler and leaves the same files,
+// diagnostics and exit status behind, without the progress output or the
+// prompt. When no server answers, the module is assembled in-process.
+//
+// Usage: sicxe_client [--socket PATH] [--binary] <input_file> <listing_file> <object_file>
+//        sicxe_client [--socket PATH] [--binary] --no-listing <input_file> <object_file>
+//
+// An input of '-' reads the source from stdin.
+
+#include "assembler.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+void printUsage(const char* program) {
+    cout << "Usage: " << program << " [--socket PATH] [--binary] <input_file> <listing_file> <object_file>" << endl;
+    cout << "       " << program << " [--socket PATH] [--binary] --no-listing <input_file> <object_file>" << endl;
+    cout << "Assembles through 'sicxe_assembler --serve' on PATH (default: $SICXE_SOCKET, else" << endl;
+    cout << "$XDG_RUNTIME_DIR/sicxe_assembler.sock, else /tmp/sicxe_assembler.<uid>/server.sock)," << endl;
+    cout << "or in-process when no server of this user's is running." << endl;
+    cout << "An input of '-' reads the source from stdin." << endl;
+}
+
+// The server has its own working directory, so it is sent absolute paths
+string absolutePath(const string& path) {
+    if (path.empty() || path[0] == '/') return path;
+    char* cwd = getcwd(nullptr, 0);
+    if (!cwd) return path;
+    string absolute = string(cwd) + "/" + path;
+    free(cwd);
+    return absolute;
+}
+
+int connectTo(const string& socketPath) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) return -1;
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sources go only to a server run by the same user; a socket someone else
+// put in place is treated as no server at all
+bool assembleRemotely(const string& socketPath, const ServerRequest& request, ServerReply& reply) {
+    if (!ownSocket(socketPath)) return false;
+    int fd = connectTo(socketPath);
+    if (fd < 0) return false;
+    if (!sameUser(fd)) {
+        close(fd);
+        return false;
+    }
+    bool answered = sendRequest(fd, request) && receiveReply(fd, reply);
+    close(fd);
+    return answered;
+}
+
+// What the server would have done, in this process
+ServerReply assembleLocally(const ServerRequest& request) {
+    ServerReply reply;
+    try {
+        SICXEAssembler assembler;
+        assembler.setBatchMode(true);
+        if (request.inlineSource) {
+            assembler.assembleSource(request.source, request.listingFile, request.objectFile, request.format);
+        } else {
+            assembler.assemble(request.input, request.listingFile, request.objectFile, request.format);
+        }
+    } catch (const AssemblyError& e) {
+        reply.status = 1;
+        reply.diagnostics = e.what();
+    } catch (const exception& e) {
+        reply.status = 1;
+        reply.diagnostics = string("Error: ") + e.what() + "\n";
+    }
+    return reply;
+}
+
+void replaceAll(string& text, const string& from, const string& to) {
+    if (from.empty() || from == to) return;
+    for (size_t at = text.find(from); at != string::npos; at = text.find(from, at + to.size())) {
+        text.replace(at, from.size(), to);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    ServerRequest request;
+    string socketPath = defaultSocketPath();
+    bool listing = true;
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; ++first) {
+        string option = argv[first];
+        if (option == "--binary") {
+            request.format = ObjectFormat::BINARY;
+        } else if (option == "--no-listing") {
+            listing = false;
+        } else if (option == "--socket" && first + 1 < argc) {
+            socketPath = argv[++first];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - first != (listing ? 3 : 2)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    string inputFile = argv[first];
+    string listingFile = listing ? argv[first + 1] : "";
+    string objectFile = argv[argc - 1];
+
+    if (inputFile == "-") {
+        request.inlineSource = true;
+        ostringstream text;
+        text << cin.rdbuf();
+        request.source = text.str();
+    } else {
+        request.input = absolutePath(inputFile);
+    }
+    request.listingFile = absolutePath(listingFile);
+    request.objectFile = absolutePath(objectFile);
+
+    ServerReply reply;
+    if (!assembleRemotely(socketPath, request, reply)) {
+        reply = assembleLocally(request);
+    }
+
+    // Diagnostics name the files the way they were given; longest path
+    // first, since one may be a prefix of another
+    vector<pair<string, string>> names = {
+        { request.input, inputFile }, { request.listingFile, listingFile }, { request.objectFile, objectFile } };
+    sort(names.begin(), names.end(), [](const pair<string, string>& a, const pair<string, string>& b) {
+        return a.first.size() > b.first.size();
+    });
+    for (const auto& name : names) {
+        replaceAll(reply.diagnostics, name.first, name.second);
+    }
+    cerr << reply.diagnostics;
+    return reply.status;
+}
@@ -0,0 +1,185 @@
+#include "assembler.h"
+
+// Incremental reassembly. Each control section's object code, T and M
+// records and line spans are kept after an assembly, under a fingerprint
+// of everything pass 2 read to produce them apart from the symbol table:
+// the section's source text, the addresses and base register pass 1 gave
+// its lines, its literal pool entries and its EXTREF list. The symbol
+// table entries its operands looked up are kept with it by value. The next
+// assembly still parses and runs pass 1 over the whole program (sections
+// share the symbol and literal tables, so one edit can move another
+// section's layout), then takes every section whose fingerprint and
+// symbols match from the cache instead of encoding it again.
+
+void SICXEAssembler::setIncremental(bool enabled) {
+    incremental = enabled;
+    if (!enabled) {
+        sectionResults.clear();
+        sectionCache.clear();
+    }
+}
+
+// Where each group's text starts in the source. Groups begin at a line
+// with a label or an opcode, which are views into the source, so the line
+// starts after the last newline before that field.
+vector<size_t> SICXEAssembler::groupTextOffsets(const vector<size_t>& bounds) {
+    const char* text = source.data();
+    vector<size_t> offsets(bounds.size(), source.size());
+    offsets[0] = 0;
+    for (size_t group = 1; group < bounds.size() && bounds[group] < sourceLines.size(); ++group) {
+        const AssemblyLine& line = sourceLines[bounds[group]];
+        size_t position = (line.label.empty() ? line.opcode : line.label).data() - text;
+        while (position > 0 && text[position - 1] != '\n') --position;
+        offsets[group] = position;
+    }
+    return offsets;
+}
+
+// Also counts the lines it visits; false if pass 1 put one of them in
+// another section
+bool SICXEAssembler::sectionFingerprint(size_t group, size_t begin, size_t end, size_t textBegin, size_t textEnd,
+                                        uint64_t& fingerprint, size_t& lines) {
+    bool inSection = true;
+    lines = 0;
+    uint64_t hash = hashBytes(source.data() + textBegin, textEnd - textBegin, (end - begin) * 2 + (group == 0));
+    if (group > 0) {
+        for (const string& name : controlSections[group - 1].extRef) {
+            hash = hashBytes(name.data(), name.size(), hash);
+        }
+    }
+    forEachLine(begin, end, [&](const AssemblyLine& line) {
+        if (line.isComment) return;
+        ++lines;
+        inSection = inSection && line.section == int(group) - 1;
+        const BaseState& base = baseStates[line.baseState];
+        hash = (hash ^ (uint64_t(uint32_t(line.address)) << 32 | uint32_t(base.address))) * 0x9E3779B97F4A7C15ULL;
+        hash = (hash ^ (hash >> 29) ^ base.set) * 0xC2B2AE3D27D4EB4FULL;
+        if (line.label == "*") {
+            hash = hashBytes(line.operand.data(), line.operand.size(), hash);
+        }
+    });
+    fingerprint = hash;
+    return inSection;
+}
+
+// Operand names are interned and resolved by now, so most names are one
+// hash probe; parts of WORD expressions may need the symbol table itself
+const Symbol* SICXEAssembler::findSymbol(string_view name) {
+    auto id = symbolIds.find(name);
+    if (id != symbolIds.end()) return resolvedSymbols[id->second];
+    auto entry = symbolTable.find(name);
+    return entry != symbolTable.end() ? &entry->second : nullptr;
+}
+
+bool SICXEAssembler::dependenciesHold(const CachedSection& cached) {
+    for (const SectionDependency& dependency : cached.dependencies) {
+        SectionDependency now(dependency.name, findSymbol(dependency.name));
+        if (now.found != dependency.found || now.address != dependency.address ||
+            now.isExternal != dependency.isExternal) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fingerprint every group and put back the ones the cache has; those are
+// marked as not to be encoded
+void SICXEAssembler::reuseSections(const vector<size_t>& bounds, vector<char>& encode) {
+    size_t groups = bounds.size() - 1;
+    vector<size_t> offsets = groupTextOffsets(bounds);
+    sectionResults.assign(groups, CachedSection());
+
+    // Label scopes are per section, so sections that do not follow each
+    // other in the source (pass 1 went back to an earlier one) are not
+    // self-contained; nothing is cached then
+    vector<size_t> lines(groups);
+    for (size_t group = 0; group < groups; ++group) {
+        if (!sectionFingerprint(group, bounds[group], bounds[group + 1], offsets[group], offsets[group + 1],
+                                sectionResults[group].fingerprint, lines[group])) {
+            sectionResults.assign(groups, CachedSection());
+            return;
+        }
+    }
+
+    for (size_t group = 0; group < groups; ++group) {
+        size_t begin = bounds[group];
+        size_t end = bounds[group + 1];
+        CachedSection& result = sectionResults[group];
+        result.cacheable = true;
+
+        auto cached = sectionCache.find(result.fingerprint);
+        if (cached == sectionCache.end() || cached->second.spans.size() != lines[group] ||
+            !dependenciesHold(cached->second)) {
+            continue;
+        }
+        result = move(cached->second);
+        sectionCache.erase(cached);
+
+        objectBytes[group] = move(result.code);
+        if (group > 0) {
+            textRecords[group - 1] = move(result.texts);
+            modificationRecords[group - 1] = move(result.modifications);
+            for (ModificationRecord& record : modificationRecords[group - 1]) {
+                record.section = group - 1;
+            }
+        }
+        size_t next = 0;
+        forEachLine(begin, end, [&](AssemblyLine& line) {
+            if (line.isComment) return;
+            line.codeOffset = result.spans[next].first;
+            line.codeLength = result.spans[next].second;
+            ++next;
+        });
+        result.complete = true;
+        encode[group] = 0;
+    }
+}
+
+// Spans and dependencies of the groups pass 2 just encoded. Every name an
+// operand or WORD expression mentions counts, found or not.
+void SICXEAssembler::recordSections(const vector<size_t>& bounds, const vector<char>& encode) {
+    for (size_t group = 0; group + 1 < bounds.size(); ++group) {
+        CachedSection& result = sectionResults[group];
+        if (!encode[group] || !result.cacheable) continue;
+
+        unordered_set<string_view> seen;
+        auto depend = [&](string_view name) {
+            if (name.empty() || !seen.insert(name).second) return;
+            result.dependencies.emplace_back(name, findSymbol(name));
+        };
+        forEachLine(bounds[group], bounds[group + 1], [&](const AssemblyLine& line) {
+            if (line.isComment) return;
+            result.spans.emplace_back(line.codeOffset, line.codeLength);
+            depend(line.decodedOperand.name);
+            if (line.op == Opcode::WORD && line.operand.find('-') != string_view::npos) {
+                for (string_view part : split(line.operand, '-')) {
+                    depend(trim(part));
+                }
+            }
+        });
+        result.complete = true;
+    }
+}
+
+// Called by reset(): the groups the last assembly finished go into the
+// cache. After a complete assembly the cache holds exactly its sections;
+// after a failed one, older entries stay for the next attempt.
+void SICXEAssembler::keepSections() {
+    bool finished = !sectionResults.empty();
+    for (const CachedSection& result : sectionResults) {
+        finished = finished && (result.complete || !result.cacheable);
+    }
+    if (finished) sectionCache.clear();
+
+    for (size_t group = 0; group < sectionResults.size(); ++group) {
+        CachedSection& result = sectionResults[group];
+        if (!result.complete) continue;
+        result.code = move(objectBytes[group]);
+        if (group > 0) {
+            result.texts = move(textRecords[group - 1]);
+            result.modifications = move(modificationRecords[group - 1]);
+        }
+        sectionCache[result.fingerprint] = move(result);
+    }
+    sectionResults.clear();
+}
@@ -1,68 +1,185 @@
 #include "assembler.h"
 
-void SICXEAssembler::initializeInstructionTable() {
+namespace {
+
+constexpr Instruction INSTRUCTIONS[] = {
     // Format 1 Instructions (1 byte)
-    instructionTable["FIX"] = Instruction("FIX", 1, "C4");
-    instructionTable["FLOAT"] = Instruction("FLOAT", 1, "C0");
-    instructionTable["HIO"] = Instruction("HIO", 1, "F4");
-    instructionTable["NORM"] = Instruction("NORM", 1, "C8");
-    instructionTable["SIO"] = Instruction("SIO", 1, "F0");
-    instructionTable["TIO"] = Instruction("TIO", 1, "F8");
-    
+    Instruction("FIX", 1, 0xC4, Opcode::FIX),
+    Instruction("FLOAT", 1, 0xC0, Opcode::FLOAT),
+    Instruction("HIO", 1, 0xF4, Opcode::HIO),
+    Instruction("NORM", 1, 0xC8, Opcode::NORM),
+    Instruction("SIO", 1, 0xF0, Opcode::SIO),
+    Instruction("TIO", 1, 0xF8, Opcode::TIO),
+
     // Format 2 Instructions (2 bytes)
-    instructionTable["ADDR"] = Instruction("ADDR", 2, "90");
-    instructionTable["CLEAR"] = Instruction("CLEAR", 2, "B4");
-    instructionTable["COMPR"] = Instruction("COMPR", 2, "A0");
-    instructionTable["DIVR"] = Instruction("DIVR", 2, "9C");
-    instructionTable["MULR"] = Instruction("MULR", 2, "98");
-    instructionTable["RMO"] = Instruction("RMO", 2, "AC");
-    instructionTable["SHIFTL"] = Instruction("SHIFTL", 2, "A4");
-    instructionTable["SHIFTR"] = Instruction("SHIFTR", 2, "A8");
-    instructionTable["SUBR"] = Instruction("SUBR", 2, "94");
-    instructionTable["SVC"] = Instruction("SVC", 2, "B0");
-    instructionTable["TIXR"] = Instruction("TIXR", 2, "B8");
-    
+    Instruction("ADDR", 2, 0x90, Opcode::ADDR),
+    Instruction("CLEAR", 2, 0xB4, Opcode::CLEAR),
+    Instruction("COMPR", 2, 0xA0, Opcode::COMPR),
+    Instruction("DIVR", 2, 0x9C, Opcode::DIVR),
+    Instruction("MULR", 2, 0x98, Opcode::MULR),
+    Instruction("RMO", 2, 0xAC, Opcode::RMO),
+    Instruction("SHIFTL", 2, 0xA4, Opcode::SHIFTL),
+    Instruction("SHIFTR", 2, 0xA8, Opcode::SHIFTR),
+    Instruction("SUBR", 2, 0x94, Opcode::SUBR),
+    Instruction("SVC", 2, 0xB0, Opcode::SVC),
+    Instruction("TIXR", 2, 0xB8, Opcode::TIXR),
+
     // Format 3/4 Instructions (3 or 4 bytes)
-    instructionTable["ADD"] = Instruction("ADD", 3, "18");
-    instructionTable["ADDF"] = Instruction("ADDF", 3, "58");
-    instructionTable["AND"] = Instruction("AND", 3, "40");
-    instructionTable["COMP"] = Instruction("COMP", 3, "28");
-    instructionTable["COMPF"] = Instruction("COMPF", 3, "88");
-    instructionTable["DIV"] = Instruction("DIV", 3, "24");
-    instructionTable["DIVF"] = Instruction("DIVF", 3, "64");
-    instructionTable["J"] = Instruction("J", 3, "3C");
-    instructionTable["JEQ"] = Instruction("JEQ", 3, "30");
-    instructionTable["JGT"] = Instruction("JGT", 3, "34");
-    instructionTable["JLT"] = Instruction("JLT", 3, "38");
-    instructionTable["JSUB"] = Instruction("JSUB", 3, "48");
-    instructionTable["LDA"] = Instruction("LDA", 3, "00");
-    instructionTable["LDB"] = Instruction("LDB", 3, "68");
-    instructionTable["LDCH"] = Instruction("LDCH", 3, "50");
-    instructionTable["LDF"] = Instruction("LDF", 3, "70");
-    instructionTable["LDL"] = Instruction("LDL", 3, "08");
-    instructionTable["LDS"] = Instruction("LDS", 3, "6C");
-    instructionTable["LDT"] = Instruction("LDT", 3, "74");
-    instructionTable["LDX"] = Instruction("LDX", 3, "04");
-    instructionTable["LPS"] = Instruction("LPS", 3, "D0");
-    instructionTable["MUL"] = Instruction("MUL", 3, "20");
-    instructionTable["MULF"] = Instruction("MULF", 3, "60");
-    instructionTable["OR"] = Instruction("OR", 3, "44");
-    instructionTable["RD"] = Instruction("RD", 3, "D8");
-    instructionTable["RSUB"] = Instruction("RSUB", 3, "4C");
-    instructionTable["SSK"] = Instruction("SSK", 3, "EC");
-    instructionTable["STA"] = Instruction("STA", 3, "0C");
-    instructionTable["STB"] = Instruction("STB", 3, "78");
-    instructionTable["STCH"] = Instruction("STCH", 3, "54");
-    instructionTable["STF"] = Instruction("STF", 3, "80");
-    instructionTable["STI"] = Instruction("STI", 3, "D4");
-    instructionTable["STL"] = Instruction("STL", 3, "14");
-    instructionTable["STS"] = Instruction("STS", 3, "7C");
-    instructionTable["STSW"] = Instruction("STSW", 3, "E8");
-    instructionTable["STT"] = Instruction("STT", 3, "84");
-    instructionTable["STX"] = Instruction("STX", 3, "10");
-    instructionTable["SUB"] = Instruction("SUB", 3, "1C");
-    instructionTable["SUBF"] = Instruction("SUBF", 3, "5C");
-    instructionTable["TD"] = Instruction("TD", 3, "E0");
-    instructionTable["TIX"] = Instruction("TIX", 3, "2C");
-    instructionTable["WD"] = Instruction("WD", 3, "DC");
+    Instruction("ADD", 3, 0x18, Opcode::ADD),
+    Instruction("ADDF", 3, 0x58, Opcode::ADDF),
+    Instruction("AND", 3, 0x40, Opcode::AND),
+    Instruction("COMP", 3, 0x28, Opcode::COMP),
+    Instruction("COMPF", 3, 0x88, Opcode::COMPF),
+    Instruction("DIV", 3, 0x24, Opcode::DIV),
+    Instruction("DIVF", 3, 0x64, Opcode::DIVF),
+    Instruction("J", 3, 0x3C, Opcode::J),
+    Instruction("JEQ", 3, 0x30, Opcode::JEQ),
+    Instruction("JGT", 3, 0x34, Opcode::JGT),
+    Instruction("JLT", 3, 0x38, Opcode::JLT),
+    Instruction("JSUB", 3, 0x48, Opcode::JSUB),
+    Instruction("LDA", 3, 0x00, Opcode::LDA),
+    Instruction("LDB", 3, 0x68, Opcode::LDB),
+    Instruction("LDCH", 3, 0x50, Opcode::LDCH),
+    Instruction("LDF", 3, 0x70, Opcode::LDF),
+    Instruction("LDL", 3, 0x08, Opcode::LDL),
+    Instruction("LDS", 3, 0x6C, Opcode::LDS),
+    Instruction("LDT", 3, 0x74, Opcode::LDT),
+    Instruction("LDX", 3, 0x04, Opcode::LDX),
+    Instruction("LPS", 3, 0xD0, Opcode::LPS),
+    Instruction("MUL", 3, 0x20, Opcode::MUL),
+    Instruction("MULF", 3, 0x60, Opcode::MULF),
+    Instruction("OR", 3, 0x44, Opcode::OR),
+    Instruction("RD", 3, 0xD8, Opcode::RD),
+    Instruction("RSUB", 3, 0x4C, Opcode::RSUB),
+    Instruction("SSK", 3, 0xEC, Opcode::SSK),
+    Instruction("STA", 3, 0x0C, Opcode::STA),
+    Instruction("STB", 3, 0x78, Opcode::STB),
+    Instruction("STCH", 3, 0x54, Opcode::STCH),
+    Instruction("STF", 3, 0x80, Opcode::STF),
+    Instruction("STI", 3, 0xD4, Opcode::STI),
+    Instruction("STL", 3, 0x14, Opcode::STL),
+    Instruction("STS", 3, 0x7C, Opcode::STS),
+    Instruction("STSW", 3, 0xE8, Opcode::STSW),
+    Instruction("STT", 3, 0x84, Opcode::STT),
+    Instruction("STX", 3, 0x10, Opcode::STX),
+    Instruction("SUB", 3, 0x1C, Opcode::SUB),
+    Instruction("SUBF", 3, 0x5C, Opcode::SUBF),
+    Instruction("TD", 3, 0xE0, Opcode::TD),
+    Instruction("TIX", 3, 0x2C, Opcode::TIX),
+    Instruction("WD", 3, 0xDC, Opcode::WD),
+
+    // Assembler directives (no machine code)
+    Instruction("START", 0, 0x00, Opcode::START),
+    Instruction("END", 0, 0x00, Opcode::END),
+    Instruction("RESW", 0, 0x00, Opcode::RESW),
+    Instruction("RESB", 0, 0x00, Opcode::RESB),
+    Instruction("WORD", 0, 0x00, Opcode::WORD),
+    Instruction("BYTE", 0, 0x00, Opcode::BYTE),
+    Instruction("CSECT", 0, 0x00, Opcode::CSECT),
+    Instruction("EXTDEF", 0, 0x00, Opcode::EXTDEF),
+    Instruction("EXTREF", 0, 0x00, Opcode::EXTREF),
+    Instruction("BASE", 0, 0x00, Opcode::BASE),
+    Instruction("NOBASE", 0, 0x00, Opcode::NOBASE),
+    Instruction("EQU", 0, 0x00, Opcode::EQU),
+    Instruction("ORG", 0, 0x00, Opcode::ORG),
+    Instruction("LTORG", 0, 0x00, Opcode::LTORG),
+    Instruction("USE", 0, 0x00, Opcode::USE),
+};
+
+constexpr size_t INSTRUCTION_COUNT = sizeof(INSTRUCTIONS) / sizeof(INSTRUCTIONS[0]);
+
+// Mnemonics are at most 7 characters, so each one packs into a unique
+// integer key (length in the top bits); 0 means "not a mnemonic".
+constexpr uint64_t packMnemonic(string_view name) {
+    if (name.empty() || name.length() > 7) return 0;
+    uint64_t key = name.length();
+    for (char c : name) {
+        key = (key << 8) | (unsigned char)c;
+    }
+    return key;
+}
+
+// Multiplicative hashing into a 512-slot table; the multiplier is searched
+// at compile time until every mnemonic lands in its own slot.
+constexpr int HASH_BITS = 9;
+constexpr size_t HASH_SIZE = size_t(1) << HASH_BITS;
+
+constexpr size_t hashSlot(uint64_t key, uint64_t multiplier) {
+    return (key * multiplier) >> (64 - HASH_BITS);
+}
+
+constexpr uint64_t splitmix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+struct PerfectHash {
+    uint64_t multiplier;
+    uint64_t keys[INSTRUCTION_COUNT];
+    uint8_t slots[HASH_SIZE];  // index into INSTRUCTIONS + 1, 0 = empty
+};
+
+constexpr PerfectHash buildPerfectHash() {
+    PerfectHash hash{};
+    for (size_t i = 0; i < INSTRUCTION_COUNT; ++i) {
+        hash.keys[i] = packMnemonic(INSTRUCTIONS[i].opcode);
+    }
+    for (uint64_t attempt = 1; attempt < 100000; ++attempt) {
+        uint64_t multiplier = splitmix(attempt) | 1;
+        for (size_t slot = 0; slot < HASH_SIZE; ++slot) {
+            hash.slots[slot] = 0;
+        }
+        bool collision = false;
+        for (size_t i = 0; i < INSTRUCTION_COUNT && !collision; ++i) {
+            size_t slot = hashSlot(hash.keys[i], multiplier);
+            collision = hash.slots[slot] != 0;
+            hash.slots[slot] = uint8_t(i + 1);
+        }
+        if (!collision) {
+            hash.multiplier = multiplier;
+            return hash;
+        }
+    }
+    hash.multiplier = 0;
+    return hash;
+}
+
+constexpr PerfectHash OPCODE_HASH = buildPerfectHash();
+static_assert(OPCODE_HASH.multiplier != 0, "no collision-free multiplier for the opcode table");
+
+constexpr const Instruction* lookup(string_view mnemonic) {
+    uint64_t key = packMnemonic(mnemonic);
+    if (key == 0) return nullptr;
+    uint8_t index = OPCODE_HASH.slots[hashSlot(key, OPCODE_HASH.multiplier)];
+    if (index == 0 || OPCODE_HASH.keys[index - 1] != key) return nullptr;
+    return &INSTRUCTIONS[index - 1];
+}
+
+static_assert(lookup("LDA")->code == Opcode::LDA, "opcode table lookup");
+static_assert(lookup("EXTREF")->code == Opcode::EXTREF, "directive table lookup");
+static_assert(lookup("LDQ") == nullptr && lookup("") == nullptr, "unknown mnemonics");
+
+} // namespace
+
+const Instruction* findInstruction(string_view mnemonic) {
+    return lookup(mnemonic);
+}
+
+// Decode the opcode field once; later passes compare line.op instead of text.
+// A '+' prefix marks format 4 and is only meaningful on instructions, so
+// "+START" and the like decode as unknown opcodes.
+void SICXEAssembler::decodeOpcode(AssemblyLine& line) {
+    string_view mnemonic = line.opcode;
+    line.extended = !mnemonic.empty() && mnemonic[0] == '+';
+    if (line.extended) {
+        mnemonic = mnemonic.substr(1);
+    }
+
+    line.instruction = findInstruction(mnemonic);
+    if (line.instruction && line.extended && line.instruction->isDirective()) {
+        line.instruction = nullptr;
+    }
+    line.op = line.instruction ? line.instruction->code : Opcode::NONE;
 }
@@ -0,0 +1,423 @@
+#include "assembler.h"
+
+// Pass 1 state file, the intermediate file of a classic two-pass
+// assembler: everything pass 2 and the output files read, so that they can
+// run later, elsewhere, or more than once.
+//
+//   "SXP1" version checksum(8) textSize(8)
+//   text   the source as parsed (fields upper-cased in place), then the
+//          few synthesized strings lines refer to ("*" of literal pools)
+//   body   varints: the final pass 1 registers, control sections, symbol
+//          table, interned operand names, BASE lines and base states,
+//          source lines, literal pools and the literal table
+//
+// Every string_view is a length and offset into the text; a loaded state
+// maps the file as the assembler's source, so the views point into it.
+// The checksum chains hashBytes() over the text size, the text and the
+// body. Object code and spans are pass 2's and are not kept.
+namespace {
+
+const char STATE_TAG[4] = { 'S', 'X', 'P', '1' };
+// Change it with anything that changes what is written below
+const uint32_t STATE_VERSION = 1;
+const size_t STATE_HEADER = sizeof(STATE_TAG) + sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+uint64_t stateChecksum(uint64_t textSize, const char* text, const char* body, size_t bodySize) {
+    uint64_t checksum = hashBytes(&textSize, sizeof(textSize));
+    checksum = hashBytes(text, textSize, checksum);
+    return hashBytes(body, bodySize, checksum);
+}
+
+// LEB128; signed values are zigzag-encoded first
+class StateWriter {
+private:
+    const char* text;
+    size_t textSize;
+    string extra;                                 // synthesized strings, after the source
+    unordered_map<string_view, size_t> extraAt;   // their offsets in the text
+    size_t previousEnd;                           // of the last view written
+
+public:
+    string body;
+
+    StateWriter(const char* source, size_t size) : text(source), textSize(size), previousEnd(0) {}
+
+    void number(uint64_t value) {
+        while (value >= 0x80) {
+            body += char(value | 0x80);
+            value >>= 7;
+        }
+        body += char(value);
+    }
+    void integer(int64_t value) { number((uint64_t(value) << 1) ^ uint64_t(value >> 63)); }
+    void flags(initializer_list<bool> bits) {
+        uint64_t value = 0, bit = 1;
+        for (bool set : bits) {
+            if (set) value |= bit;
+            bit <<= 1;
+        }
+        number(value);
+    }
+    void bytes(string_view value) {
+        number(value.size());
+        body.append(value.data(), value.size());
+    }
+    // A length and, unless empty, the offset from where the previous view
+    // ended (the fields of a line follow each other, so mostly a byte).
+    // Views into the source are stored as they are; others are copied in
+    // after it once, and shared by every view with the same text.
+    void view(string_view value) {
+        number(value.size());
+        if (value.empty()) return;
+        size_t offset;
+        if (value.data() >= text && value.data() + value.size() <= text + textSize) {
+            offset = value.data() - text;
+        } else {
+            auto known = extraAt.find(value);
+            if (known == extraAt.end()) {
+                known = extraAt.emplace(value, textSize + extra.size()).first;
+                extra.append(value.data(), value.size());
+            }
+            offset = known->second;
+        }
+        integer(int64_t(offset) - int64_t(previousEnd));
+        previousEnd = offset + value.size();
+    }
+    size_t size() const { return textSize + extra.size(); }
+    string_view extraText() const { return extra; }
+};
+
+class StateReader {
+private:
+    const uint8_t* next;
+    const uint8_t* end;
+    const char* text;
+    size_t textSize;
+    size_t previousEnd;
+
+public:
+    bool ok;
+
+    StateReader(const char* body, size_t size, const char* t, size_t tSize)
+        : next(reinterpret_cast<const uint8_t*>(body)), end(next + size), text(t), textSize(tSize), previousEnd(0),
+          ok(true) {}
+
+    uint64_t number() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (next == end) break;
+            uint8_t byte = *next++;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+    int64_t integer() {
+        uint64_t value = number();
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+    // In [low, high)
+    int integer(int64_t low, int64_t high) {
+        int64_t value = integer();
+        if (value < low || value >= high) ok = false;
+        return ok ? int(value) : 0;
+    }
+    int value() { return integer(INT32_MIN, int64_t(INT32_MAX) + 1); }
+    bool flag(uint64_t bits, int index) { return (bits >> index) & 1; }
+    // Element counts; each element takes at least a byte
+    size_t count() {
+        uint64_t value = number();
+        if (value > uint64_t(end - next)) ok = false;
+        return ok ? size_t(value) : 0;
+    }
+    string bytes() {
+        size_t length = count();
+        string value(reinterpret_cast<const char*>(next), length);
+        next += length;
+        return value;
+    }
+    string_view view() {
+        uint64_t length = number();
+        if (length == 0) return string_view();
+        int64_t offset = int64_t(previousEnd) + integer();
+        if (offset < 0 || uint64_t(offset) > textSize || length > textSize - offset) ok = false;
+        if (!ok) return string_view();
+        previousEnd = offset + length;
+        return string_view(text + offset, length);
+    }
+    bool finished() const { return ok && next == end; }
+};
+
+// Line numbers and addresses are relative to the line before
+void saveLine(const AssemblyLine& line, const AssemblyLine& previous, StateWriter& out) {
+    const Operand& operand = line.decodedOperand;
+    out.integer(int64_t(line.lineNumber) - previous.lineNumber);
+    out.view(line.label);
+    out.view(line.opcode);
+    out.view(line.operand);
+    out.view(line.comment);
+    out.integer(int64_t(line.address) - previous.address);
+    out.flags({ line.isComment, operand.isConstant, operand.isRegister, operand.immediate, operand.indirect,
+                operand.indexed, operand.literal, operand.validRegisters });
+    out.view(line.controlSection);
+    out.integer(line.section);
+    out.integer(line.baseState);
+    out.view(operand.name);
+    out.integer(operand.symbol);
+    out.integer(operand.value);
+    out.integer(operand.registers[0]);
+    out.integer(operand.registers[1]);
+}
+
+// Ids and indices are checked against the tables already loaded; the
+// caller decodes the opcode again, as it only depends on the text
+void loadLine(AssemblyLine& line, const AssemblyLine& previous, StateReader& in, size_t sections,
+              size_t baseStates, size_t symbols) {
+    Operand& operand = line.decodedOperand;
+    line.lineNumber = in.integer(INT32_MIN - int64_t(previous.lineNumber),
+                                 INT32_MAX - int64_t(previous.lineNumber) + 1) + previous.lineNumber;
+    line.label = in.view();
+    line.opcode = in.view();
+    line.operand = in.view();
+    line.comment = in.view();
+    line.address = in.integer(INT32_MIN - int64_t(previous.address), INT32_MAX - int64_t(previous.address) + 1) +
+                   previous.address;
+    uint64_t bits = in.number();
+    line.isComment = in.flag(bits, 0);
+    operand.isConstant = in.flag(bits, 1);
+    operand.isRegister = in.flag(bits, 2);
+    operand.immediate = in.flag(bits, 3);
+    operand.indirect = in.flag(bits, 4);
+    operand.indexed = in.flag(bits, 5);
+    operand.literal = in.flag(bits, 6);
+    operand.validRegisters = in.flag(bits, 7);
+    line.controlSection = in.view();
+    line.section = in.integer(-1, sections);
+    line.baseState = in.integer(0, baseStates);
+    operand.name = in.view();
+    operand.symbol = in.integer(-1, symbols);
+    operand.value = in.value();
+    operand.registers[0] = in.integer(-1, 16);
+    operand.registers[1] = in.integer(-1, 16);
+}
+
+} // namespace
+
+void SICXEAssembler::assemblePass1(const string& inputFile, const string& stateFile) {
+    reset();
+
+    ostream log(batchMode ? nullptr : cout.rdbuf());
+    log << "Starting SIC-XE Pass 1..." << endl;
+    log << "Input file: " << inputFile << endl;
+    if (!source.open(inputFile)) {
+        throw AssemblyError("Error: Cannot open source file " + inputFile + "\n");
+    }
+    parseSource();
+    log << "Parsed " << sourceLines.size() << " lines." << endl;
+    pass1();
+    log << "Pass 1 completed. Found " << symbolTable.size() << " symbols." << endl;
+
+    if (!savePass1(stateFile)) {
+        throw AssemblyError("Error: Cannot create pass 1 state file " + stateFile + "\n");
+    }
+    log << "Pass 1 state file generated: " << stateFile << endl;
+}
+
+void SICXEAssembler::assembleFromPass1(const string& stateFile, const string& listingFile, const string& objectFile,
+                                       ObjectFormat format) {
+    reset();
+
+    ostream log(batchMode ? nullptr : cout.rdbuf());
+    log << "Starting SIC-XE Pass 2..." << endl;
+    log << "Pass 1 state file: " << stateFile << endl;
+    loadPass1(stateFile);
+    log << "Loaded " << sourceLines.size() << " lines, " << symbolTable.size() << " symbols and "
+        << controlSections.size() << " control sections." << endl;
+    assemblePass2(listingFile, objectFile, format, log);
+}
+
+bool SICXEAssembler::savePass1(const string& stateFile) {
+    StateWriter out(source.data(), source.size());
+
+    out.integer(locationCounter);
+    out.view(currentControlSection);
+    out.integer(currentSection);
+    out.integer(baseRegister);
+    out.flags({ baseSet });
+
+    out.number(controlSections.size());
+    for (const ControlSection& section : controlSections) {
+        out.bytes(section.name);
+        out.integer(section.startAddress);
+        out.integer(section.length);
+        out.number(section.extDef.size());
+        for (const string& name : section.extDef) out.bytes(name);
+        out.number(section.extRef.size());
+        for (const string& name : section.extRef) out.bytes(name);
+    }
+
+    out.number(symbolTable.size());
+    for (const auto& symbol : symbolTable) {
+        out.bytes(symbol.first);
+        out.integer(symbol.second.address);
+        out.bytes(symbol.second.controlSection);
+        out.flags({ symbol.second.isExternal, symbol.second.isDefined });
+    }
+
+    out.number(symbolNames.size());
+    for (string_view name : symbolNames) out.view(name);
+    out.number(baseLines.size());
+    for (size_t line : baseLines) out.number(line);
+    out.number(baseStates.size());
+    for (const BaseState& base : baseStates) {
+        out.integer(base.address);
+        out.flags({ base.set });
+    }
+
+    out.number(sourceLines.size());
+    for (size_t i = 0; i < sourceLines.size(); ++i) {
+        saveLine(sourceLines[i], i > 0 ? sourceLines[i - 1] : AssemblyLine(), out);
+    }
+    out.number(literalLines.size());
+    for (size_t i = 0; i < literalLines.size(); ++i) {
+        saveLine(literalLines[i], i > 0 ? literalLines[i - 1] : AssemblyLine(), out);
+    }
+    out.number(literalPools.size());
+    for (const LiteralPool& pool : literalPools) {
+        out.number(pool.line);
+        out.number(pool.first);
+        out.number(pool.last);
+    }
+
+    out.number(literalTable.size());
+    for (const auto& literal : literalTable) {
+        out.view(literal.first);
+        out.integer(literal.second);
+    }
+    out.number(pendingLiterals.size());
+    for (string_view literal : pendingLiterals) out.view(literal);
+
+    string text(source.data(), source.size());
+    text += out.extraText();
+    uint64_t textSize = text.size();
+    uint64_t checksum = stateChecksum(textSize, text.data(), out.body.data(), out.body.size());
+
+    OutputBuffer file;
+    file << string_view(STATE_TAG, sizeof(STATE_TAG));
+    memcpy(file.reserve(sizeof(STATE_VERSION)), &STATE_VERSION, sizeof(STATE_VERSION));
+    memcpy(file.reserve(sizeof(checksum)), &checksum, sizeof(checksum));
+    memcpy(file.reserve(sizeof(textSize)), &textSize, sizeof(textSize));
+    file << text << out.body;
+    return file.writeTo(stateFile);
+}
+
+void SICXEAssembler::loadPass1(const string& stateFile) {
+    if (!source.open(stateFile)) {
+        throw AssemblyError("Error: Cannot open pass 1 state file " + stateFile + "\n");
+    }
+    const char* data = source.data();
+    size_t size = source.size();
+    if (size < STATE_HEADER || memcmp(data, STATE_TAG, sizeof(STATE_TAG)) != 0) {
+        throw AssemblyError("Error: " + stateFile + " is not a pass 1 state file\n");
+    }
+    uint32_t version;
+    uint64_t checksum, textSize;
+    memcpy(&version, data + 4, sizeof(version));
+    memcpy(&checksum, data + 8, sizeof(checksum));
+    memcpy(&textSize, data + 16, sizeof(textSize));
+    if (version != STATE_VERSION) {
+        throw AssemblyError("Error: Pass 1 state file " + stateFile + " has version " + to_string(version) +
+                            "; this assembler reads version " + to_string(STATE_VERSION) + "\n");
+    }
+    string damaged = "Error: Pass 1 state file " + stateFile + " is damaged\n";
+    const char* text = data + STATE_HEADER;
+    if (textSize > size - STATE_HEADER ||
+        stateChecksum(textSize, text, text + textSize, size - STATE_HEADER - textSize) != checksum) {
+        throw AssemblyError(damaged);
+    }
+
+    StateReader in(text + textSize, size - STATE_HEADER - textSize, text, textSize);
+
+    locationCounter = in.value();
+    currentControlSection = in.view();
+    currentSection = in.integer(-1, INT32_MAX);
+    baseRegister = in.value();
+    baseSet = in.flag(in.number(), 0);
+
+    // Sections are all in place before their EXTREF sets take views of
+    // their names
+    controlSections.resize(in.count());
+    for (ControlSection& section : controlSections) {
+        section.name = in.bytes();
+        section.startAddress = in.value();
+        section.length = in.value();
+        section.extDef.resize(in.count());
+        for (string& name : section.extDef) name = in.bytes();
+        section.extRef.resize(in.count());
+        for (string& name : section.extRef) name = in.bytes();
+        section.extRefSet.insert(section.extRef.begin(), section.extRef.end());
+    }
+
+    for (size_t symbols = in.count(); in.ok && symbols > 0; --symbols) {
+        string name = in.bytes();
+        Symbol& symbol = symbolTable[name];
+        symbol.address = in.value();
+        symbol.controlSection = in.bytes();
+        uint64_t bits = in.number();
+        symbol.isExternal = in.flag(bits, 0);
+        symbol.isDefined = in.flag(bits, 1);
+    }
+
+    symbolNames.resize(in.count());
+    for (size_t id = 0; id < symbolNames.size(); ++id) {
+        symbolNames[id] = in.view();
+        symbolIds.emplace(symbolNames[id], int(id));
+    }
+    baseLines.resize(in.count());
+    for (size_t& line : baseLines) line = in.number();
+    baseStates.resize(in.count());
+    for (BaseState& base : baseStates) {
+        base.address = in.value();
+        base.set = in.flag(in.number(), 0);
+    }
+
+    sourceLines.resize(in.count());
+    for (size_t i = 0; i < sourceLines.size(); ++i) {
+        loadLine(sourceLines[i], i > 0 ? sourceLines[i - 1] : AssemblyLine(), in, controlSections.size(),
+                 baseStates.size(), symbolNames.size());
+        decodeOpcode(sourceLines[i]);
+    }
+    literalLines.resize(in.count());
+    for (size_t i = 0; i < literalLines.size(); ++i) {
+        loadLine(literalLines[i], i > 0 ? literalLines[i - 1] : AssemblyLine(), in, controlSections.size(),
+                 baseStates.size(), symbolNames.size());
+        decodeOpcode(literalLines[i]);
+    }
+    size_t pools = in.count();
+    literalPools.reserve(pools);
+    while (in.ok && literalPools.size() < pools) {
+        size_t line = in.number();
+        size_t first = in.number();
+        size_t last = in.number();
+        // In program order, as forEachLine() expects
+        bool ordered = literalPools.empty() || (literalPools.back().line <= line && literalPools.back().last <= first);
+        if (!ordered || line >= sourceLines.size() || first > last || last > literalLines.size()) in.ok = false;
+        literalPools.push_back(LiteralPool(line, first, last));
+    }
+
+    for (size_t literals = in.count(); in.ok && literals > 0; --literals) {
+        string_view literal = in.view();
+        literalTable[literal] = in.value();
+    }
+    pendingLiterals.resize(in.count());
+    for (string_view& literal : pendingLiterals) {
+        literal = in.view();
+        pendingLiteralSet.insert(literal);
+    }
+
+    for (size_t line : baseLines) {
+        if (line >= sourceLines.size()) in.ok = false;
+    }
+    if (!in.finished()) throw AssemblyError(damaged);
+}
@@ -0,0 +1,180 @@
+#include "assembler.h"
+#include "thread_pool.h"
+
+// Links with fewer records than this relocate on the calling thread
+static const size_t PARALLEL_RELOCATION_MIN = 4096;
+
+namespace {
+
+string hexAddress(int value) {
+    char digits[8];
+    *formatHex(digits, uint32_t(value), 6) = '\0';
+    return digits;
+}
+
+// Adds or subtracts 'value' in the 'halfBytes' low-order half-bytes
+// starting at 'field' (an odd count leaves the first high half-byte alone)
+void modifyField(uint8_t* field, int halfBytes, int value, bool addition) {
+    int bytes = (halfBytes + 1) / 2;
+    uint64_t word = 0;
+    for (int i = 0; i < bytes; ++i) word = (word << 8) | field[i];
+    uint64_t mask = (uint64_t(1) << (4 * halfBytes)) - 1;
+    uint64_t modified = addition ? word + uint64_t(int64_t(value)) : word - uint64_t(int64_t(value));
+    word = (word & ~mask) | (modified & mask);
+    for (int i = bytes - 1; i >= 0; --i) {
+        field[i] = uint8_t(word);
+        word >>= 8;
+    }
+}
+
+// Copies one section's text and applies its modifications; every write
+// stays inside the section, so sections can be relocated concurrently
+void relocateSection(const ObjectSection& section, const LoadedSection& placed, LoadImage& image,
+                     string& errors) {
+    uint8_t* base = image.memory.data() + (placed.address - image.loadAddress);
+    auto inside = [&](int address, int length) {
+        int offset = address - section.startAddress;
+        return offset >= 0 && length >= 0 && offset <= placed.length - length;
+    };
+
+    for (const TextRecord& text : section.texts) {
+        if (!inside(text.startAddress, text.length)) {
+            errors += "Error: T record at " + hexAddress(text.startAddress) + " is outside control section " +
+                      section.name + "\n";
+            continue;
+        }
+        memcpy(base + (text.startAddress - section.startAddress), section.code.data() + text.offset, text.length);
+    }
+
+    for (const ModificationRecord& modification : section.modifications) {
+        if (modification.length <= 0 || modification.length > 8 ||
+            !inside(modification.address, (modification.length + 1) / 2)) {
+            errors += "Error: M record at " + hexAddress(modification.address) + " is outside control section " +
+                      section.name + "\n";
+            continue;
+        }
+        // The section's own name relocates an address it assembled from
+        // its START, so that is taken back out
+        int value = placed.address - section.startAddress;
+        if (modification.symbol != section.name) {
+            auto symbol = image.estab.find(modification.symbol);
+            if (symbol == image.estab.end()) {
+                errors += "Error: Undefined external symbol '" + modification.symbol + "' in M record at " +
+                          hexAddress(modification.address) + " of control section " + section.name + "\n";
+                continue;
+            }
+            value = symbol->second;
+        }
+        modifyField(base + (modification.address - section.startAddress), modification.length, value,
+                    modification.isAddition);
+    }
+}
+
+} // namespace
+
+// Each section gets the next free address (CSADDR), and its name and D
+// record symbols go into ESTAB at CSADDR plus their offset in it
+bool placeSections(const vector<ObjectModule>& modules, int loadAddress, LoadImage& image) {
+    image = LoadImage();
+    image.loadAddress = loadAddress;
+    image.entryAddress = loadAddress;
+    bool entryFound = false;
+    bool ok = true;
+
+    auto define = [&](const string& name, int address, const ObjectSection& section) {
+        if (!image.estab.emplace(name, address).second) {
+            cerr << "Error: Duplicate external symbol '" << name << "' in control section " << section.name << endl;
+            ok = false;
+        }
+    };
+
+    int64_t next = loadAddress;
+    for (size_t m = 0; m < modules.size(); ++m) {
+        for (size_t s = 0; s < modules[m].sections.size(); ++s) {
+            const ObjectSection& section = modules[m].sections[s];
+            // Literals END puts in the last section follow its H record
+            // length, so the T records decide how much room it takes
+            int length = section.length;
+            for (const TextRecord& text : section.texts) {
+                length = max(length, text.startAddress - section.startAddress + text.length);
+            }
+            if (length < 0 || next + length > MEMORY_SIZE) {
+                cerr << "Error: Control section " << section.name << " does not fit in memory at "
+                     << hexAddress(int(next)) << endl;
+                return false;
+            }
+
+            LoadedSection placed;
+            placed.name = section.name;
+            placed.module = m;
+            placed.section = s;
+            placed.address = int(next);
+            placed.length = length;
+            define(section.name, placed.address, section);
+            for (const auto& definition : section.definitions) {
+                int address = placed.address + (definition.second - section.startAddress);
+                placed.symbols.emplace_back(definition.first, address);
+                define(definition.first, address, section);
+            }
+            if (section.hasEntry && !entryFound) {
+                image.entryAddress = placed.address + (section.entryAddress - section.startAddress);
+                entryFound = true;
+            }
+            image.sections.push_back(move(placed));
+            next += length;
+        }
+    }
+    image.memory.assign(size_t(next - loadAddress), 0);
+    return ok;
+}
+
+bool relocateSections(const vector<ObjectModule>& modules, LoadImage& image) {
+    size_t sectionCount = image.sections.size();
+    vector<string> errors(sectionCount);
+    size_t records = 0;
+    for (const LoadedSection& placed : image.sections) {
+        const ObjectSection& section = modules[placed.module].sections[placed.section];
+        records += section.texts.size() + section.modifications.size();
+    }
+
+    auto relocate = [&](size_t i) {
+        const LoadedSection& placed = image.sections[i];
+        relocateSection(modules[placed.module].sections[placed.section], placed, image, errors[i]);
+    };
+    ThreadPool& pool = ThreadPool::shared();
+    if (records < PARALLEL_RELOCATION_MIN || sectionCount < 2 || pool.size() < 2) {
+        for (size_t i = 0; i < sectionCount; ++i) relocate(i);
+    } else {
+        pool.parallelFor(sectionCount, relocate);
+    }
+
+    // Reported in load order, whichever section finished first
+    bool ok = true;
+    for (const string& error : errors) {
+        cerr << error;
+        ok = ok && error.empty();
+    }
+    return ok;
+}
+
+void writeLoadMap(const LoadImage& image, const vector<string>& moduleNames, OutputBuffer& out) {
+    out << "Load address " << hexAddress(image.loadAddress) << ", entry point " << hexAddress(image.entryAddress)
+        << ", " << hexAddress(int(image.memory.size())) << " bytes\n\n";
+    out << "Section\tSymbol\tAddress\tLength\tModule\n";
+    out << "-------\t------\t-------\t------\t------\n";
+    for (const LoadedSection& placed : image.sections) {
+        out.pad(placed.name, 7);
+        out << "\t\t";
+        out.hex(placed.address, 6);
+        out << '\t';
+        out.hex(placed.length, 6);
+        out << '\t' << moduleNames[placed.module] << '\n';
+        for (const auto& symbol : placed.symbols) {
+            out << '\t';
+            out.pad(symbol.first, 6);
+            out << '\t';
+            out.hex(symbol.second, 6);
+            out << '\n';
+        }
+    }
+}
@@ -0,0 +1,140 @@
+// Linking loader: loads one or more object files (text or binary format)
+// one after the other from a load address, resolves their external
+// references and writes the memory image and a load map.
+//
+// Usage: sicxe_loader [-a ADDRESS] [-o IMAGE] [-m MAP] [-j N] [--timings] <object_file>...
+
+#include "assembler.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <thread>
+
+static void printUsage(const char* program) {
+    cout << "Usage: " << program << " [-a ADDRESS] [-o IMAGE] [-m MAP] [-j N] [--timings] <object_file>..." << endl;
+    cout << "  -a ADDRESS  load address in hex (default: 0)" << endl;
+    cout << "  -o IMAGE    write the memory image, from the load address on, to IMAGE" << endl;
+    cout << "  -m MAP      write the load map to MAP instead of standard output" << endl;
+    cout << "  -j N        read and relocate with N threads (default: one per core)" << endl;
+    cout << "  --timings   print how long each step took on standard error" << endl;
+}
+
+static bool readModule(const string& path, ObjectModule& module, ostream& log) {
+    SourceBuffer input;
+    if (!input.open(path)) {
+        log << "Error: Cannot open object file " << path << endl;
+        return false;
+    }
+    if (isBinaryObject(input.data(), input.size())) {
+        return readObjectBinary(input.data(), input.size(), module, log);
+    }
+    return readObjectText(string_view(input.data(), input.size()), module, log);
+}
+
+int main(int argc, char* argv[]) {
+    int loadAddress = 0;
+    string imageFile;
+    string mapFile;
+    size_t jobs = 0;
+    bool timings = false;
+    int first = 1;
+    bool badOption = false;
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        string option = argv[first];
+        if (option == "-a" && first + 1 < argc) {
+            char* end = nullptr;
+            unsigned long address = strtoul(argv[++first], &end, 16);
+            badOption = badOption || *argv[first] == '\0' || *end != '\0' || address >= 0x100000;
+            loadAddress = int(address & 0xFFFFF);
+        } else if (option == "-o" && first + 1 < argc) {
+            imageFile = argv[++first];
+        } else if (option == "-m" && first + 1 < argc) {
+            mapFile = argv[++first];
+        } else if (option == "--timings") {
+            timings = true;
+        } else if (option.compare(0, 2, "-j") == 0) {
+            string count = option.length() > 2 ? option.substr(2) : (first + 1 < argc ? argv[++first] : "");
+            char* end = nullptr;
+            jobs = strtoul(count.c_str(), &end, 10);
+            badOption = badOption || count.empty() || *end != '\0' || jobs == 0;
+        } else {
+            badOption = true;
+        }
+    }
+    if (badOption || first == argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    ThreadPool::setSharedSize(jobs ? jobs : max(1u, thread::hardware_concurrency()));
+
+    vector<string> files(argv + first, argv + argc);
+    vector<ObjectModule> modules(files.size());
+    auto start = chrono::steady_clock::now();
+    vector<pair<const char*, double>> steps;
+    auto step = [&](const char* name) {
+        auto now = chrono::steady_clock::now();
+        steps.emplace_back(name, chrono::duration<double>(now - start).count());
+        start = now;
+    };
+
+    // Diagnostics are kept per file and printed in the order given
+    vector<string> diagnostics(files.size());
+    vector<char> read(files.size());
+    ThreadPool::shared().parallelFor(files.size(), [&](size_t i) {
+        ostringstream log;
+        read[i] = readModule(files[i], modules[i], log);
+        diagnostics[i] = log.str();
+    });
+    bool ok = true;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (read[i]) continue;
+        cerr << files[i] << ":" << endl << diagnostics[i];
+        ok = false;
+    }
+    if (!ok) return 1;
+    step("read");
+
+    LoadImage image;
+    if (!placeSections(modules, loadAddress, image)) return 1;
+    step("ESTAB");
+    if (!relocateSections(modules, image)) return 1;
+    step("relocation");
+
+    if (!imageFile.empty()) {
+        OutputBuffer output;
+        output << string_view(reinterpret_cast<const char*>(image.memory.data()), image.memory.size());
+        if (!output.writeTo(imageFile)) {
+            cerr << "Error: Cannot create image file " << imageFile << endl;
+            return 1;
+        }
+    }
+    OutputBuffer map;
+    writeLoadMap(image, files, map);
+    if (mapFile.empty()) {
+        string text;
+        map.copyTo(text);
+        cout << text;
+    } else if (!map.writeTo(mapFile)) {
+        cerr << "Error: Cannot create load map " << mapFile << endl;
+        return 1;
+    }
+    step("write");
+
+    if (timings) {
+        size_t records = 0;
+        for (const LoadedSection& placed : image.sections) {
+            const ObjectSection& section = modules[placed.module].sections[placed.section];
+            records += section.texts.size() + section.modifications.size();
+        }
+        cerr << files.size() << " modules, " << image.sections.size() << " control sections, " << image.estab.size()
+             << " external symbols, " << records << " T and M records, " << ThreadPool::shared().size()
+             << " threads" << endl;
+        double total = 0;
+        for (const auto& timing : steps) {
+            cerr << "  " << left << setw(12) << timing.first << fixed << setprecision(3) << timing.second * 1000
+                 << " ms" << endl;
+            total += timing.second;
+        }
+        cerr << "  " << left << setw(12) << "total" << fixed << setprecision(3) << total * 1000 << " ms" << endl;
+    }
+    return 0;
+}
@@ -1,47 +1,144 @@
 #include "assembler.h"
+#include "thread_pool.h"
+#include <cerrno>
+#include <exception>
+#include <thread>
 
-void SICXEAssembler::assemble(const string& inputFile, const string& listingFile, const string& objectFile) {
-    cout << "Starting SIC-XE Assembly Process..." << endl;
-    cout << "Input file: " << inputFile << endl;
-    
-    // Parse source file
-    cout << "Parsing source file..." << endl;
-    parseSourceFile(inputFile);
-    cout << "Parsed " << sourceLines.size() << " lines." << endl;
-    
-    // Pass 1
-    cout << "Starting Pass 1..." << endl;
-    pass1();
-    cout << "Pass 1 completed. Found " << symbolTable.size() << " symbols." << endl;
-    cout << "Control sections: " << controlSections.size() << endl;
-    
-    // Pass 2
-    cout << "Starting Pass 2..." << endl;
-    pass2();
-    cout << "Pass 2 completed. Generated object codes." << endl;
-    
-    // Generate output files
-    cout << "Generating output files..." << endl;
-    generateListingFile(listingFile);
-    generateObjectFile(objectFile);
-    
-    cout << "Assembly completed successfully!" << endl;
+// Default limit of a --cache directory
+static const uint64_t DEFAULT_CACHE_MB = 512;
+
+static void printUsage(const char* program) {
+    cout << "Usage: " << program << " [options] <input_file> <listing_file> <object_file>" << endl;
+    cout << "       " << program << " [options] --no-listing <input_file> <object_file>" << endl;
+    cout << "       " << program << " --batch [-j N] [options] [--no-listing] <file.asm | @manifest>..." << endl;
+    cout << "       " << program << " --serve [-j N] [--cache DIR [--cache-size MB]] [socket]" << endl;
+    cout << "       " << program << " --pass1 <input_file> <state_file>" << endl;
+    cout << "       " << program << " --pass2 [--binary] [--no-listing] <state_file> <listing_file> <object_file>" << endl;
+    cout << "Options: [--binary] [--cache DIR [--cache-size MB]]" << endl;
+    cout << "Example: " << program << " program.asm program.lst program.obj" << endl;
+    cout << "  --binary      write the object file in the binary format (see sicxe_objconv)" << endl;
+    cout << "  --no-listing  skip the listing file" << endl;
+    cout << "  --batch       assemble many modules without prompting; each file.asm gets" << endl;
+    cout << "                file.lst and file.obj, and a manifest lists one module per line" << endl;
+    cout << "                as '<input>' or '<input> <listing> <object>'" << endl;
+    cout << "  --serve       keep running and assemble for sicxe_client over a Unix socket" << endl;
+    cout << "                (default: $SICXE_SOCKET, else $XDG_RUNTIME_DIR/sicxe_assembler.sock," << endl;
+    cout << "                else /tmp/sicxe_assembler.<uid>/server.sock)" << endl;
+    cout << "  -j N          assemble N modules at once (default: one per core)" << endl;
+    cout << "  --cache DIR   keep assembled modules in DIR, keyed by source and options, and" << endl;
+    cout << "                copy the outputs from there when the same module comes again" << endl;
+    cout << "  --cache-size MB  remove the least recently used entries beyond this size" << endl;
+    cout << "                (default: " << DEFAULT_CACHE_MB << ")" << endl;
+    cout << "  --pass1       run pass 1 only and write its state to state_file" << endl;
+    cout << "  --pass2       run pass 2 and write the outputs from a --pass1 state_file" << endl;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        cout << "Usage: " << argv[0] << " <input_file> <listing_file> <object_file>" << endl;
-        cout << "Example: " << argv[0] << " program.asm program.lst program.obj" << endl;
+    // Options come before the file names
+    BatchOptions options;
+    bool batch = false;
+    bool serve = false;
+    bool pass1Only = false;
+    bool pass2Only = false;
+    size_t jobs = 0;
+    string cacheDirectory;
+    uint64_t cacheMegabytes = DEFAULT_CACHE_MB;
+    int first = 1;
+    bool badOption = false;
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        string option = argv[first];
+        if (option == "--binary") {
+            options.format = ObjectFormat::BINARY;
+        } else if (option == "--no-listing") {
+            options.listing = false;
+        } else if (option == "--batch") {
+            batch = true;
+        } else if (option == "--serve") {
+            serve = true;
+        } else if (option == "--pass1") {
+            pass1Only = true;
+        } else if (option == "--pass2") {
+            pass2Only = true;
+        } else if (option == "--cache" && first + 1 < argc) {
+            cacheDirectory = argv[++first];
+            badOption = badOption || cacheDirectory.empty();
+        } else if (option == "--cache-size" && first + 1 < argc) {
+            char* end = nullptr;
+            cacheMegabytes = strtoull(argv[++first], &end, 10);
+            badOption = badOption || *argv[first] == '\0' || *end != '\0' || cacheMegabytes == 0;
+        } else if (option.compare(0, 2, "-j") == 0) {
+            string count = option.length() > 2 ? option.substr(2) : (first + 1 < argc ? argv[++first] : "");
+            char* end = nullptr;
+            jobs = strtoul(count.c_str(), &end, 10);
+            badOption = badOption || count.empty() || *end != '\0' || jobs == 0;
+        } else {
+            badOption = true;
+        }
+    }
+    
+    // The pass 1 state file splits one assembly: no batches, servers or
+    // cache, and pass 1 has no output options
+    if (pass1Only || pass2Only) {
+        badOption = badOption || batch || serve || (pass1Only && pass2Only) || !cacheDirectory.empty() ||
+                    (pass1Only && (options.format == ObjectFormat::BINARY || !options.listing));
+    }
+    
+    // One cache for the whole process; its users need no locking
+    unique_ptr<BuildCache> cache;
+    if (!cacheDirectory.empty() && !badOption) {
+        cache.reset(new BuildCache(cacheDirectory, cacheMegabytes << 20));
+        if (!cache->open()) {
+            cerr << "Error: Cannot use cache directory " << cacheDirectory << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        options.cache = cache.get();
+    }
+    
+    if (serve) {
+        if (badOption || batch || argc - first > 1) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        // Every connection holds a pool worker while it is open
+        jobs = jobs ? jobs : max(1u, thread::hardware_concurrency());
+        ThreadPool::setSharedSize(jobs);
+        return runServer(first < argc ? argv[first] : defaultSocketPath(), jobs, options.cache);
+    }
+    
+    if (batch) {
+        if (badOption || first == argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        // The batch itself runs on the calling thread plus the pool's workers
+        options.jobs = jobs ? jobs : max(1u, thread::hardware_concurrency());
+        ThreadPool::setSharedSize(max<size_t>(options.jobs - 1, 1));
+        return runBatch(vector<string>(argv + first, argv + argc), options);
+    }
+    
+    // Without a listing the listing file name is left out
+    int files = pass1Only ? 2 : (options.listing ? 3 : 2);
+    if (badOption || jobs != 0 || argc - first != files) {
+        printUsage(argv[0]);
         return 1;
     }
     
-    string inputFile = argv[1];
-    string listingFile = argv[2];
-    string objectFile = argv[3];
+    string inputFile = argv[first];
+    string listingFile = options.listing ? argv[first + 1] : "";
+    string objectFile = argv[argc - 1];
     
     try {
         SICXEAssembler assembler;
-        assembler.assemble(inputFile, listingFile, objectFile);
+        assembler.setBuildCache(options.cache);
+        if (pass1Only) {
+            assembler.assemblePass1(inputFile, argv[first + 1]);
+            return 0;
+        }
+        if (pass2Only) {
+            assembler.assembleFromPass1(inputFile, listingFile, objectFile, options.format);
+            return 0;
+        }
+        assembler.assemble(inputFile, listingFile, objectFile, options.format);
         
         // Optional: Print symbol table and control sections
         cout << "\nWould you like to see the symbol table and control sections? (y/n): ";
@@ -52,6 +149,9 @@ int main(int argc, char* argv[]) {
             assembler.printControlSections();
         }
         
+    } catch (const AssemblyError& e) {
+        cerr << e.what();
+        return 1;
     } catch (const exception& e) {
         cerr << "Error: " << e.what() << endl;
         return 1;
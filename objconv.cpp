@@ -0,0 +1,40 @@
+// Converts object files between the text (H^/D^/R^/T^/M^/E) and binary
+// formats. The input format is detected from the file; the output is the
+// other one. Converting there and back reproduces the input exactly.
+//
+// Usage: sicxe_objconv <input_object> <output_object>
+
+#include "assembler.h"
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cout << "Usage: " << argv[0] << " <input_object> <output_object>" << endl;
+        cout << "Text object files are converted to binary and binary ones to text." << endl;
+        return 1;
+    }
+
+    SourceBuffer input;
+    if (!input.open(argv[1])) {
+        cerr << "Error: Cannot open object file " << argv[1] << endl;
+        return 1;
+    }
+
+    ObjectModule module;
+    OutputBuffer output;
+    bool binary = isBinaryObject(input.data(), input.size());
+    if (binary) {
+        if (!readObjectBinary(input.data(), input.size(), module)) return 1;
+        writeObjectText(module, output);
+    } else {
+        if (!readObjectText(string_view(input.data(), input.size()), module)) return 1;
+        writeObjectBinary(module, output);
+    }
+
+    if (!output.writeTo(argv[2])) {
+        cerr << "Error: Cannot create object file " << argv[2] << endl;
+        return 1;
+    }
+    cout << "Converted " << (binary ? "binary" : "text") << " object file " << argv[1] << " to "
+         << (binary ? "text" : "binary") << ": " << argv[2] << endl;
+    return 0;
+}
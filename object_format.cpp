@@ -0,0 +1,488 @@
+#include "assembler.h"
+#include "object_format.h"
+
+// Text format
+
+void writeObjectText(const ObjectModule& module, OutputBuffer& file) {
+    for (const ObjectSection& cs : module.sections) {
+        // Header record
+        file << "H^";
+        file.pad(cs.name, 6);
+        file << '^';
+        file.hex(cs.startAddress, 6);
+        file << '^';
+        file.hex(cs.length, 6);
+        file << '\n';
+
+        // Define record (if external definitions exist)
+        if (!cs.definitions.empty()) {
+            file << 'D';
+            for (const auto& definition : cs.definitions) {
+                file << '^';
+                file.pad(definition.first, 6);
+                file << '^';
+                file.hex(definition.second, 6);
+            }
+            file << '\n';
+        }
+
+        // Refer record (if external references exist)
+        if (!cs.references.empty()) {
+            file << 'R';
+            for (const auto& symbol : cs.references) {
+                file << '^';
+                file.pad(symbol, 6);
+            }
+            file << '\n';
+        }
+
+        // Text records
+        for (const auto& textRecord : cs.texts) {
+            file << "T^";
+            file.hex(textRecord.startAddress, 6);
+            file << '^';
+            file.hex(textRecord.length, 2);
+
+            // Object codes: the payload is encoded in one go straight into
+            // the buffer, then opened up at the instruction boundaries
+            size_t pieces = textRecord.pieces.size();
+            char* out = file.reserve(textRecord.length * 2 + pieces + 1);
+            char* digits = out + pieces;
+            encodeHex(cs.code.data() + textRecord.offset, textRecord.length, digits);
+            for (int piece : textRecord.pieces) {
+                *out++ = '^';
+                memmove(out, digits, piece * 2);
+                out += piece * 2;
+                digits += piece * 2;
+            }
+            *out = '\n';
+        }
+
+        // Modification records
+        for (const auto& modRecord : cs.modifications) {
+            file << "M^";
+            file.hex(modRecord.address, 6);
+            file << '^';
+            file.hex(modRecord.length, 2);
+            file << '^' << (modRecord.isAddition ? '+' : '-') << modRecord.symbol << '\n';
+        }
+
+        // End record
+        file << 'E';
+        if (cs.hasEntry) {
+            file << '^';
+            file.hex(cs.entryAddress, 6);
+        }
+        file << '\n';
+    }
+}
+
+namespace {
+
+// Names are left-justified in 6 columns; the padding is not part of them
+string_view unpadded(string_view field) {
+    while (!field.empty() && field.back() == ' ') field.remove_suffix(1);
+    return field;
+}
+
+// At most 'digits' hex digits, the record format's width
+bool parseHexField(string_view field, size_t digits, int& value) {
+    if (field.empty() || field.length() > digits) return false;
+    value = 0;
+    for (char c : field) {
+        int digit = hexDigitValue(c);
+        if (digit < 0) return false;
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+// Addresses are below MEMORY_SIZE and section lengths at most that, so
+// nothing downstream does arithmetic on larger values. Six digits that are
+// out of range set 'outOfRange', for a clearer diagnostic.
+bool parseAddress(string_view field, int& value, bool& outOfRange, int limit = MEMORY_SIZE - 1) {
+    if (!parseHexField(field, 6, value)) return false;
+    outOfRange = value > limit;
+    return !outOfRange;
+}
+
+bool parseHexBytes(string_view field, vector<uint8_t>& code) {
+    if (field.length() % 2 != 0) return false;
+    for (size_t i = 0; i < field.length(); i += 2) {
+        int high = hexDigitValue(field[i]);
+        int low = hexDigitValue(field[i + 1]);
+        if (high < 0 || low < 0) return false;
+        code.push_back(uint8_t((high << 4) | low));
+    }
+    return true;
+}
+
+bool parseRecord(string_view record, ObjectModule& module, bool& outOfRange) {
+    vector<string_view> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t caret = record.find('^', start);
+        fields.push_back(record.substr(start, caret == string_view::npos ? string_view::npos : caret - start));
+        if (caret == string_view::npos) break;
+        start = caret + 1;
+    }
+
+    char type = record[0];
+    if (fields[0].length() != 1) return false;
+    if (type == 'H') {
+        ObjectSection section;
+        if (fields.size() != 4) return false;
+        section.name = string(unpadded(fields[1]));
+        if (!parseAddress(fields[2], section.startAddress, outOfRange) ||
+            !parseAddress(fields[3], section.length, outOfRange, MEMORY_SIZE)) {
+            return false;
+        }
+        module.sections.push_back(move(section));
+        return true;
+    }
+    if (module.sections.empty()) return false;
+    ObjectSection& section = module.sections.back();
+
+    switch (type) {
+        case 'D':
+            if (fields.size() % 2 != 1) return false;
+            for (size_t i = 1; i < fields.size(); i += 2) {
+                int address;
+                if (!parseAddress(fields[i + 1], address, outOfRange)) return false;
+                section.definitions.emplace_back(string(unpadded(fields[i])), address);
+            }
+            return true;
+        case 'R':
+            for (size_t i = 1; i < fields.size(); ++i) {
+                section.references.emplace_back(unpadded(fields[i]));
+            }
+            return true;
+        case 'T': {
+            if (fields.size() < 4) return false;
+            int address, length;
+            if (!parseAddress(fields[1], address, outOfRange) || !parseHexField(fields[2], 2, length)) return false;
+            TextRecord text(address, section.code.size());
+            text.length = length;
+            for (size_t i = 3; i < fields.size(); ++i) {
+                if (!parseHexBytes(fields[i], section.code)) return false;
+                text.pieces.push_back(fields[i].length() / 2);
+            }
+            if (section.code.size() - text.offset != size_t(length)) return false;
+            section.texts.push_back(move(text));
+            return true;
+        }
+        case 'M': {
+            int address, length;
+            if (fields.size() != 4 || fields[3].empty()) return false;
+            if (!parseAddress(fields[1], address, outOfRange) || !parseHexField(fields[2], 2, length)) return false;
+            char sign = fields[3][0];
+            if (sign != '+' && sign != '-') return false;
+            section.modifications.emplace_back(address, length, fields[3].substr(1),
+                                               module.sections.size() - 1, sign == '+');
+            return true;
+        }
+        case 'E':
+            if (fields.size() > 2) return false;
+            section.hasEntry = fields.size() == 2;
+            return !section.hasEntry || parseAddress(fields[1], section.entryAddress, outOfRange);
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+bool readObjectText(string_view text, ObjectModule& module, ostream& log) {
+    module.sections.clear();
+    int lineNumber = 0;
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        string_view record = text.substr(0, newline);
+        text.remove_prefix(newline == string_view::npos ? text.length() : newline + 1);
+        ++lineNumber;
+
+        if (!record.empty() && record.back() == '\r') record.remove_suffix(1);
+        if (record.empty()) continue;
+        bool outOfRange = false;
+        if (!parseRecord(record, module, outOfRange)) {
+            log << "Error on line " << lineNumber << ": "
+                << (outOfRange ? "Address out of range (SIC/XE memory ends at 100000)" : "Malformed object record")
+                << ": " << record << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Binary format
+
+namespace {
+
+inline uint32_t alignTo4(uint32_t offset) {
+    return (offset + 3) & ~uint32_t(3);
+}
+
+// Names are stored once each, NUL-terminated, in first-use order
+class StringTable {
+private:
+    unordered_map<string_view, uint32_t> offsets;
+    vector<string_view> names;
+    uint32_t size;
+
+public:
+    StringTable() : size(0) {}
+
+    uint32_t add(string_view name) {
+        auto inserted = offsets.emplace(name, size);
+        if (inserted.second) {
+            names.push_back(name);
+            size += name.length() + 1;
+        }
+        return inserted.first->second;
+    }
+    uint32_t bytes() const { return size; }
+    void write(char* out) const {
+        for (string_view name : names) {
+            memcpy(out, name.data(), name.length());
+            out[name.length()] = '\0';
+            out += name.length() + 1;
+        }
+    }
+};
+
+template <class Entry>
+void writeTable(OutputBuffer& out, uint32_t& written, const BinaryTable& table, const vector<Entry>& entries) {
+    char* padding = out.reserve(table.offset - written);
+    memset(padding, 0, table.offset - written);
+    size_t bytes = entries.size() * sizeof(Entry);
+    if (bytes > 0) memcpy(out.reserve(bytes), entries.data(), bytes);
+    written = table.offset + bytes;
+}
+
+} // namespace
+
+void writeObjectBinary(const ObjectModule& module, OutputBuffer& out) {
+    StringTable strings;
+    vector<BinarySection> sections;
+    vector<BinaryDefinition> definitions;
+    vector<BinaryReference> references;
+    vector<BinaryText> texts;
+    vector<uint8_t> pieces;
+    vector<BinaryModification> modifications;
+    vector<uint8_t> code;
+
+    for (const ObjectSection& cs : module.sections) {
+        BinarySection section{};
+        section.name = strings.add(cs.name);
+        section.startAddress = cs.startAddress;
+        section.length = cs.length;
+        section.entryAddress = cs.hasEntry ? cs.entryAddress : 0;
+        section.flags = cs.hasEntry ? SECTION_HAS_ENTRY : 0;
+
+        section.definitionCount = cs.definitions.size();
+        for (const auto& definition : cs.definitions) {
+            definitions.push_back(BinaryDefinition{ strings.add(definition.first), uint32_t(definition.second) });
+        }
+
+        section.referenceCount = cs.references.size();
+        for (const auto& symbol : cs.references) {
+            references.push_back(BinaryReference{ strings.add(symbol) });
+        }
+
+        // T records are at most 0xFF bytes (two hex digits), so a piece
+        // fits in a byte
+        section.textCount = cs.texts.size();
+        for (const auto& textRecord : cs.texts) {
+            texts.push_back(BinaryText{ uint32_t(textRecord.startAddress), uint16_t(textRecord.length),
+                                        uint16_t(textRecord.pieces.size()) });
+            pieces.insert(pieces.end(), textRecord.pieces.begin(), textRecord.pieces.end());
+            const uint8_t* bytes = cs.code.data() + textRecord.offset;
+            code.insert(code.end(), bytes, bytes + textRecord.length);
+        }
+
+        section.modificationCount = cs.modifications.size();
+        for (const auto& modRecord : cs.modifications) {
+            modifications.push_back(BinaryModification{ uint32_t(modRecord.address), strings.add(modRecord.symbol),
+                                                        uint16_t(modRecord.length),
+                                                        modRecord.isAddition ? uint16_t(0) : MODIFICATION_SUBTRACT });
+        }
+        sections.push_back(section);
+    }
+
+    // Lay the tables out back to back, each on a 4-byte boundary
+    BinaryObjectHeader header{};
+    memcpy(header.magic, BINARY_OBJECT_MAGIC, sizeof(header.magic));
+    header.version = BINARY_OBJECT_VERSION;
+    uint32_t offset = sizeof(BinaryObjectHeader);
+    auto place = [&offset](BinaryTable& table, size_t count, size_t entrySize) {
+        table.offset = alignTo4(offset);
+        table.count = count;
+        offset = table.offset + count * entrySize;
+    };
+    place(header.sections, sections.size(), sizeof(BinarySection));
+    place(header.definitions, definitions.size(), sizeof(BinaryDefinition));
+    place(header.references, references.size(), sizeof(BinaryReference));
+    place(header.texts, texts.size(), sizeof(BinaryText));
+    place(header.pieces, pieces.size(), 1);
+    place(header.modifications, modifications.size(), sizeof(BinaryModification));
+    place(header.code, code.size(), 1);
+    place(header.strings, strings.bytes(), 1);
+    header.fileSize = offset;
+
+    memcpy(out.reserve(sizeof(header)), &header, sizeof(header));
+    uint32_t written = sizeof(header);
+    writeTable(out, written, header.sections, sections);
+    writeTable(out, written, header.definitions, definitions);
+    writeTable(out, written, header.references, references);
+    writeTable(out, written, header.texts, texts);
+    writeTable(out, written, header.pieces, pieces);
+    writeTable(out, written, header.modifications, modifications);
+    writeTable(out, written, header.code, code);
+
+    memset(out.reserve(header.strings.offset - written), 0, header.strings.offset - written);
+    strings.write(out.reserve(strings.bytes()));
+}
+
+bool isBinaryObject(const char* data, size_t size) {
+    return size >= sizeof(BinaryObjectHeader) && memcmp(data, BINARY_OBJECT_MAGIC, sizeof(BINARY_OBJECT_MAGIC)) == 0;
+}
+
+namespace {
+
+// Every table must lie inside the file and be aligned for in-place use
+bool validTable(const BinaryTable& table, size_t entrySize, size_t fileSize) {
+    return table.offset % 4 == 0 && table.offset <= fileSize &&
+           uint64_t(table.count) * entrySize <= fileSize - table.offset;
+}
+
+// Takes the next 'count' entries of a table whose first 'next' are used
+bool claim(uint32_t& next, uint32_t count, uint32_t tableCount) {
+    if (next > tableCount || count > tableCount - next) return false;
+    next += count;
+    return true;
+}
+
+} // namespace
+
+bool readObjectBinary(const char* data, size_t size, ObjectModule& module, ostream& log) {
+    module.sections.clear();
+    if (!isBinaryObject(data, size) || reinterpret_cast<uintptr_t>(data) % 4 != 0) {
+        log << "Error: Not a binary object file" << endl;
+        return false;
+    }
+
+    const BinaryObjectHeader& header = *reinterpret_cast<const BinaryObjectHeader*>(data);
+    if (header.version != BINARY_OBJECT_VERSION) {
+        log << "Error: Unsupported binary object version " << header.version << endl;
+        return false;
+    }
+    if (header.fileSize > size ||
+        !validTable(header.sections, sizeof(BinarySection), size) ||
+        !validTable(header.definitions, sizeof(BinaryDefinition), size) ||
+        !validTable(header.references, sizeof(BinaryReference), size) ||
+        !validTable(header.texts, sizeof(BinaryText), size) ||
+        !validTable(header.pieces, 1, size) ||
+        !validTable(header.modifications, sizeof(BinaryModification), size) ||
+        !validTable(header.code, 1, size) ||
+        !validTable(header.strings, 1, size)) {
+        log << "Error: Truncated or corrupt binary object file" << endl;
+        return false;
+    }
+
+    const auto* sections = reinterpret_cast<const BinarySection*>(data + header.sections.offset);
+    const auto* definitions = reinterpret_cast<const BinaryDefinition*>(data + header.definitions.offset);
+    const auto* references = reinterpret_cast<const BinaryReference*>(data + header.references.offset);
+    const auto* texts = reinterpret_cast<const BinaryText*>(data + header.texts.offset);
+    const auto* pieces = reinterpret_cast<const uint8_t*>(data + header.pieces.offset);
+    const auto* modifications = reinterpret_cast<const BinaryModification*>(data + header.modifications.offset);
+    const auto* code = reinterpret_cast<const uint8_t*>(data + header.code.offset);
+    const char* strings = data + header.strings.offset;
+
+    bool valid = true;
+    bool inRange = true;
+    auto name = [&](uint32_t offset) {
+        const char* end = offset < header.strings.count ? static_cast<const char*>(
+                              memchr(strings + offset, '\0', header.strings.count - offset)) : nullptr;
+        if (!end) {
+            valid = false;
+            return string();
+        }
+        return string(strings + offset, end);
+    };
+
+    // Each section's records follow the previous section's
+    uint32_t nextDefinition = 0, nextReference = 0, nextText = 0, nextModification = 0;
+    uint32_t nextPiece = 0, nextCode = 0;
+    for (uint32_t s = 0; s < header.sections.count && valid && inRange; ++s) {
+        const BinarySection& entry = sections[s];
+        uint32_t firstDefinition = nextDefinition, firstReference = nextReference;
+        uint32_t firstText = nextText, firstModification = nextModification;
+        if (!claim(nextDefinition, entry.definitionCount, header.definitions.count) ||
+            !claim(nextReference, entry.referenceCount, header.references.count) ||
+            !claim(nextText, entry.textCount, header.texts.count) ||
+            !claim(nextModification, entry.modificationCount, header.modifications.count)) {
+            valid = false;
+            break;
+        }
+
+        if (entry.startAddress >= MEMORY_SIZE || entry.length > MEMORY_SIZE || entry.entryAddress >= MEMORY_SIZE) {
+            inRange = false;
+            break;
+        }
+
+        ObjectSection section;
+        section.name = name(entry.name);
+        section.startAddress = entry.startAddress;
+        section.length = entry.length;
+        section.hasEntry = (entry.flags & SECTION_HAS_ENTRY) != 0;
+        section.entryAddress = entry.entryAddress;
+
+        for (uint32_t i = 0; i < entry.definitionCount; ++i) {
+            const BinaryDefinition& definition = definitions[firstDefinition + i];
+            inRange = inRange && definition.address < MEMORY_SIZE;
+            section.definitions.emplace_back(name(definition.name), int(definition.address));
+        }
+        for (uint32_t i = 0; i < entry.referenceCount; ++i) {
+            section.references.push_back(name(references[firstReference + i].name));
+        }
+        for (uint32_t i = 0; i < entry.textCount && valid; ++i) {
+            const BinaryText& text = texts[firstText + i];
+            uint32_t firstPiece = nextPiece, firstCode = nextCode;
+            inRange = inRange && text.address < MEMORY_SIZE;
+            if (!claim(nextCode, text.length, header.code.count) ||
+                !claim(nextPiece, text.pieceCount, header.pieces.count)) {
+                valid = false;
+                break;
+            }
+            TextRecord record(text.address, section.code.size());
+            record.length = text.length;
+            uint32_t total = 0;
+            for (uint32_t p = 0; p < text.pieceCount; ++p) {
+                record.pieces.push_back(pieces[firstPiece + p]);
+                total += pieces[firstPiece + p];
+            }
+            valid = total == text.length;
+            section.code.insert(section.code.end(), code + firstCode, code + firstCode + text.length);
+            section.texts.push_back(move(record));
+        }
+        for (uint32_t i = 0; i < entry.modificationCount; ++i) {
+            const BinaryModification& modRecord = modifications[firstModification + i];
+            inRange = inRange && modRecord.address < MEMORY_SIZE;
+            section.modifications.emplace_back(modRecord.address, modRecord.length, name(modRecord.symbol), s,
+                                               (modRecord.flags & MODIFICATION_SUBTRACT) == 0);
+        }
+        module.sections.push_back(move(section));
+    }
+
+    if (!inRange) {
+        log << "Error: Address out of range in binary object file (SIC/XE memory ends at 100000)" << endl;
+        module.sections.clear();
+        return false;
+    }
+    if (!valid) {
+        log << "Error: Truncated or corrupt binary object file" << endl;
+        module.sections.clear();
+        return false;
+    }
+    return true;
+}
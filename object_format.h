@@ -0,0 +1,94 @@
+#ifndef OBJECT_FORMAT_H
+#define OBJECT_FORMAT_H
+
+#include <cstdint>
+
+// Binary object file layout (sicxe_assembler --binary). Everything is
+// little-endian and every table starts on a 4-byte boundary, so a consumer
+// can mmap the file and index the tables in place:
+//
+//   BinaryObjectHeader
+//   sections       BinarySection[sections.count]
+//   definitions    BinaryDefinition[]   (D records, all sections)
+//   references     BinaryReference[]    (R records)
+//   texts          BinaryText[]         (T records)
+//   pieces         uint8_t[]            (object code length of each line in a T record)
+//   modifications  BinaryModification[] (M records)
+//   code           uint8_t[]            (T record payloads, back to back)
+//   strings        char[]               (names, each followed by a NUL)
+//
+// The records of each section follow those of the section before it in
+// every table, as the pieces and payload of each T record follow the
+// previous one's; only counts are stored. Names are offsets of
+// NUL-terminated strings. A file is smaller than its text form: a T record
+// takes 8 bytes plus one per code byte and one per line, where the text
+// takes 12 plus two per code byte and one per line.
+
+const char BINARY_OBJECT_MAGIC[4] = { 'S', 'X', 'O', 'B' };
+const uint32_t BINARY_OBJECT_VERSION = 2;
+
+struct BinaryTable {
+    uint32_t offset;   // from the start of the file
+    uint32_t count;    // entries (bytes for pieces, code and strings)
+};
+
+struct BinaryObjectHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t fileSize;
+    BinaryTable sections;
+    BinaryTable definitions;
+    BinaryTable references;
+    BinaryTable texts;
+    BinaryTable pieces;
+    BinaryTable modifications;
+    BinaryTable code;
+    BinaryTable strings;
+};
+
+const uint32_t SECTION_HAS_ENTRY = 1;   // the E record carries entryAddress
+
+struct BinarySection {
+    uint32_t name;   // offset into the string table
+    uint32_t startAddress;
+    uint32_t length;
+    uint32_t entryAddress;
+    uint32_t flags;
+    uint32_t definitionCount;
+    uint32_t referenceCount;
+    uint32_t textCount;
+    uint32_t modificationCount;
+};
+
+struct BinaryDefinition {
+    uint32_t name;
+    uint32_t address;
+};
+
+struct BinaryReference {
+    uint32_t name;
+};
+
+struct BinaryText {
+    uint32_t address;
+    uint16_t length;       // code bytes
+    uint16_t pieceCount;   // lines
+};
+
+const uint16_t MODIFICATION_SUBTRACT = 1;   // '-' instead of '+'
+
+struct BinaryModification {
+    uint32_t address;
+    uint32_t symbol;
+    uint16_t length;       // in half-bytes
+    uint16_t flags;
+};
+
+static_assert(sizeof(BinaryObjectHeader) == 76, "binary object header layout");
+static_assert(sizeof(BinarySection) == 36, "binary section layout");
+static_assert(sizeof(BinaryDefinition) == 8, "binary definition layout");
+static_assert(sizeof(BinaryReference) == 4, "binary reference layout");
+static_assert(sizeof(BinaryText) == 8, "binary text layout");
+static_assert(sizeof(BinaryModification) == 12, "binary modification layout");
+
+#endif // OBJECT_FORMAT_H
@@ -1,313 +1,307 @@
 #include "assembler.h"
+#include "thread_pool.h"
 
-void SICXEAssembler::generateTextRecords() {
-    textRecords.clear();
+// Build the T records of one section from its source lines [begin, end).
+// The open record is closed on an address gap or when the next object code
+// would overflow it. Lines are visited in the order pass 2 laid out their
+// bytes, so a record is one contiguous run of the buffer.
+void SICXEAssembler::generateTextRecords(int section, size_t begin, size_t end) {
+    const int MAX_TEXT_LENGTH = 30; // bytes
     
-    for (const auto& cs : controlSections) {
-        TextRecord currentRecord(-1, cs.name);
-        int currentLength = 0;
-        const int MAX_TEXT_LENGTH = 60; // 30 bytes = 60 hex characters
+    vector<TextRecord>& records = textRecords[section];
+    TextRecord current(-1);
+    int lastObjectCodeEndAddress = -1;
+    
+    forEachLine(begin, end, [&](const AssemblyLine& line) {
+        // Skip lines without object code (RESB, RESW, EQU, LTORG, etc.)
+        if (line.section != section || line.codeLength == 0) {
+            return;
+        }
         
-        int lastObjectCodeAddress = -1;
-        int lastObjectCodeEndAddress = -1;
+        // Check if there's a gap between the last instruction with object code and current one
+        bool hasGap = lastObjectCodeEndAddress != -1 && line.address > lastObjectCodeEndAddress;
         
-        for (const auto& line : sourceLines) {
-            if (line.controlSection != cs.name) {
-                continue;
-            }
-            
-            // Skip lines without object code (RESB, RESW, EQU, LTORG, etc.)
-            if (line.objectCode.empty()) {
-                continue;
-            }
-            
-            // Check if there's a gap between the last instruction with object code and current one
-            bool hasGap = false;
-            if (lastObjectCodeEndAddress != -1 && line.address > lastObjectCodeEndAddress) {
-                hasGap = true;
-            }
-            
-            // Start new record if needed or if there's a gap
-            if (currentRecord.startAddress == -1 || hasGap) {
-                // Save current record if it has content
-                if (currentRecord.startAddress != -1 && !currentRecord.objectCodes.empty()) {
-                    textRecords.push_back(currentRecord);
-                }
-                currentRecord = TextRecord(line.address, cs.name);
-                currentLength = 0;
+        // Start new record if needed or if there's a gap
+        if (current.startAddress == -1 || hasGap) {
+            // Save current record if it has content
+            if (!current.pieces.empty()) {
+                records.push_back(move(current));
             }
-            
-            // Check if adding this object code would exceed max length
-            int objectCodeLength = line.objectCode.length();
-            if (currentLength + objectCodeLength > MAX_TEXT_LENGTH) {
-                // Save current record and start new one
-                if (!currentRecord.objectCodes.empty()) {
-                    textRecords.push_back(currentRecord);
-                }
-                currentRecord = TextRecord(line.address, cs.name);
-                currentLength = 0;
+            current = TextRecord(line.address, line.codeOffset);
+        }
+        
+        // Check if adding this object code would exceed max length
+        if (current.length + line.codeLength > MAX_TEXT_LENGTH) {
+            // Save current record and start new one
+            if (!current.pieces.empty()) {
+                records.push_back(move(current));
             }
-            
-            currentRecord.objectCodes.push_back(line.objectCode);
-            currentLength += objectCodeLength;
-            lastObjectCodeAddress = line.address;
-            lastObjectCodeEndAddress = line.address + (objectCodeLength / 2); // Convert hex chars to bytes
+            current = TextRecord(line.address, line.codeOffset);
         }
         
-        // Save the last record for this control section
-        if (!currentRecord.objectCodes.empty()) {
-            textRecords.push_back(currentRecord);
+        // A line longer than a whole record (a long BYTE string) is spread
+        // over several, so that no record needs more than two length digits
+        int address = line.address;
+        int remaining = line.codeLength;
+        while (remaining > MAX_TEXT_LENGTH) {
+            current.pieces.push_back(MAX_TEXT_LENGTH);
+            current.length += MAX_TEXT_LENGTH;
+            records.push_back(move(current));
+            address += MAX_TEXT_LENGTH;
+            remaining -= MAX_TEXT_LENGTH;
+            current = TextRecord(address, line.codeOffset + (address - line.address));
         }
+        current.pieces.push_back(remaining);
+        current.length += remaining;
+        lastObjectCodeEndAddress = line.address + line.codeLength;
+    });
+    
+    // Save the last record of the section
+    if (!current.pieces.empty()) {
+        records.push_back(move(current));
     }
 }
 
-void SICXEAssembler::generateModificationRecords() {
-    // Additional modification records for WORD directives and other cases
-    for (const auto& line : sourceLines) {
-        if (line.isComment || line.objectCode.empty()) continue;
+// Modification records for the source lines [begin, end), in one walk:
+// addresses rise with the lines, so the records come out sorted by address
+void SICXEAssembler::generateModificationRecords(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        const AssemblyLine& line = sourceLines[i];
+        if (line.isComment || line.codeLength == 0) continue;
+        
+        if (line.extended && line.instruction && line.instruction->format == 3) {
+            // Externals are fixed up with the symbol itself; other symbols are
+            // relocated by the address of the control section
+            const Operand& operand = line.decodedOperand;
+            if (isExternalOperand(line)) {
+                addModificationRecord(ModificationRecord(line.address + 1, 5, operand.name, line.section));
+            } else if (!(operand.immediate && operand.isConstant) && lookupSymbol(operand)) {
+                addModificationRecord(ModificationRecord(line.address + 1, 5, line.controlSection, line.section));
+            }
+            continue;
+        }
         
         // Handle WORD directive with external symbol references
-        if (line.opcode == "WORD" && !line.operand.empty()) {
+        if (line.op == Opcode::WORD && !line.operand.empty()) {
             // Check if operand is an external reference
-            string operand = line.operand;
+            string_view operand = line.operand;
             
             // Handle expressions like BUFEND-BUFFER
-            if (operand.find('-') != string::npos) {
-                vector<string> parts = split(operand, '-');
+            if (operand.find('-') != string_view::npos) {
+                vector<string_view> parts = split(operand, '-');
                 if (parts.size() == 2) {
-                    string symbol1 = trim(parts[0]);
-                    string symbol2 = trim(parts[1]);
+                    string_view symbol1 = trim(parts[0]);
+                    string_view symbol2 = trim(parts[1]);
                     
                     // Check if either symbol is external
-                    if (isExternalReference(symbol1, line.controlSection)) {
-                        modificationRecords.push_back(ModificationRecord(line.address, 6, symbol1, true));
+                    if (isExternalReference(symbol1, line.section)) {
+                        addModificationRecord(ModificationRecord(line.address, 6, symbol1, line.section, true));
                     }
-                    if (isExternalReference(symbol2, line.controlSection)) {
-                        modificationRecords.push_back(ModificationRecord(line.address, 6, symbol2, false));
+                    if (isExternalReference(symbol2, line.section)) {
+                        addModificationRecord(ModificationRecord(line.address, 6, symbol2, line.section, false));
                     }
                 }
             } else {
                 // Single symbol reference
-                if (isExternalReference(operand, line.controlSection)) {
-                    modificationRecords.push_back(ModificationRecord(line.address, 6, operand, true));
+                if (isExternalReference(operand, line.section)) {
+                    addModificationRecord(ModificationRecord(line.address, 6, operand, line.section, true));
                 }
             }
         }
-        
-        // Handle Format 3 instructions with external references
-        if (!line.opcode.empty() && line.opcode[0] != '+' && 
-            instructionTable.find(line.opcode) != instructionTable.end() &&
-            instructionTable[line.opcode].format == 3 && !line.operand.empty()) {
-            
-            string baseOperand = getBaseOperand(line.operand);
-            if (isExternalReference(baseOperand, line.controlSection)) {
-                modificationRecords.push_back(ModificationRecord(line.address + 1, 5, baseOperand, true));
-            }
-        }
     }
 }
 
-bool SICXEAssembler::isExternalReference(const string& symbol, const string& controlSection) {
+// Records arrive in address order (see generateModificationRecords), so
+// filing one under its section is an append
+void SICXEAssembler::addModificationRecord(const ModificationRecord& record) {
+    if (record.section < 0) return;  // outside any section: nothing to emit it in
+    modificationRecords[record.section].push_back(record);
+}
+
+bool SICXEAssembler::isExternalReference(string_view symbol, int section) {
     // First check if symbol is marked as external in symbol table
-    if (symbolTable.find(symbol) != symbolTable.end() && 
-        symbolTable[symbol].isExternal) {
+    auto entry = symbolTable.find(symbol);
+    if (entry != symbolTable.end() && entry->second.isExternal) {
         return true;
     }
     
-    // Check if symbol is in the EXTREF list of the given control section
-    for (const auto& cs : controlSections) {
-        if (cs.name == controlSection) {
-            for (const auto& extRef : cs.extRef) {
-                if (extRef == symbol) {
-                    return true;
-                }
-            }
-            break;
-        }
-    }
-    
-    return false;
+    // Then the EXTREF set of the given control section
+    return section >= 0 && controlSections[section].refersTo(symbol);
 }
 
-void SICXEAssembler::generateListingFile(const string& filename) {
-    ofstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error: Cannot create listing file " << filename << endl;
-        return;
-    }
+// Listings longer than PARALLEL_LISTING_MIN lines are formatted in chunks
+// of LISTING_CHUNK_LINES source lines on the thread pool, each into its own
+// buffer; the buffers are then chained in order without copying.
+static const size_t PARALLEL_LISTING_MIN = 16384;
+static const size_t LISTING_CHUNK_LINES = 4096;
+
+bool SICXEAssembler::generateListingFile(const string& filename) {
+    formatListing();
+    return listingOutput.writeTo(filename);
+}
+
+void SICXEAssembler::formatListing() {
+    OutputBuffer& file = listingOutput;
+    file.clear();
     
-    file << "Line#\tAddress\tLabel\t\tOpcode\t\tOperand\t\tObject Code\tComment" << endl;
-    file << "-----\t-------\t-----\t\t------\t\t-------\t\t-----------\t-------" << endl;
+    file << "Line#\tAddress\tLabel\t\tOpcode\t\tOperand\t\tObject Code\tComment\n";
+    file << "-----\t-------\t-----\t\t------\t\t-------\t\t-----------\t-------\n";
     
-    for (const auto& line : sourceLines) {
-        file << setw(5) << line.lineNumber << "\t";
-        
-        if (line.isComment) {
-            file << "\t\t\t\t\t\t\t" << line.comment << endl;
-            continue;
+    size_t firstCodeLine = 0;
+    while (firstCodeLine < sourceLines.size() && sourceLines[firstCodeLine].isComment) ++firstCodeLine;
+    
+    ThreadPool& pool = ThreadPool::shared();
+    if (sourceLines.size() < PARALLEL_LISTING_MIN || pool.size() < 2) {
+        formatListingLines(0, sourceLines.size(), firstCodeLine, file);
+    } else {
+        size_t chunkCount = (sourceLines.size() + LISTING_CHUNK_LINES - 1) / LISTING_CHUNK_LINES;
+        vector<OutputBuffer> chunks(chunkCount);
+        pool.parallelFor(chunkCount, [&](size_t i) {
+            size_t begin = i * LISTING_CHUNK_LINES;
+            formatListingLines(begin, min(begin + LISTING_CHUNK_LINES, sourceLines.size()), firstCodeLine, chunks[i]);
+        });
+        for (auto& chunk : chunks) {
+            file.append(chunk);
         }
-        
-        file << intToHex(line.address, 4) << "\t";
-        file << setw(8) << left << line.label << "\t";
-        file << setw(8) << left << line.opcode << "\t";
-        file << setw(12) << left << line.operand << "\t";
-        file << setw(12) << left << line.objectCode << "\t";
-        file << line.comment << endl;
     }
     
-    file << endl << "Symbol Table:" << endl;
-    file << "Symbol\t\tAddress\t\tControl Section" << endl;
-    file << "------\t\t-------\t\t---------------" << endl;
+    file << "\nSymbol Table:\n";
+    file << "Symbol\t\tAddress\t\tControl Section\n";
+    file << "------\t\t-------\t\t---------------\n";
     
     for (const auto& symbol : symbolTable) {
         if (!symbol.second.isExternal) {
-            file << setw(8) << left << symbol.first << "\t";
-            file << intToHex(symbol.second.address, 4) << "\t\t";
-            file << symbol.second.controlSection << endl;
+            file.pad(symbol.first, 8);
+            file << '\t';
+            file.hex(symbol.second.address, 4);
+            file << "\t\t" << symbol.second.controlSection << '\n';
         }
     }
-    
-    file.close();
-    cout << "Listing file generated: " << filename << endl;
 }
 
-void SICXEAssembler::generateObjectFile(const string& filename) {
-    ofstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error: Cannot create object file " << filename << endl;
-        return;
-    }
-    
-    for (const auto& cs : controlSections) {
-        // Header record
-        file << "H^" << setw(6) << left << cs.name << "^";
-        file << intToHex(cs.startAddress, 6) << "^";
-        file << intToHex(cs.length, 6) << endl;
+// Listing lines for the source lines [begin, end) and the literal pools
+// they place. The listing used to be written through an ostream whose
+// 'left' flag stuck after the first label column, so line numbers are
+// right-aligned only up to the first non-comment line.
+void SICXEAssembler::formatListingLines(size_t begin, size_t end, size_t firstCodeLine, OutputBuffer& file) {
+    bool leftAligned = begin > firstCodeLine;
+    forEachLine(begin, end, [&](const AssemblyLine& line) {
+        file.number(line.lineNumber, 5, leftAligned);
+        file << '\t';
         
-        // Define record (if external definitions exist)
-        if (!cs.extDef.empty()) {
-            file << "D";
-            for (const auto& symbol : cs.extDef) {
-                file << "^" << setw(6) << left << symbol;
-                if (symbolTable.find(symbol) != symbolTable.end()) {
-                    file << "^" << intToHex(symbolTable[symbol].address, 6);
-                } else {
-                    file << "^000000";
-                }
-            }
-            file << endl;
+        if (line.isComment) {
+            file << "\t\t\t\t\t\t\t" << line.comment << '\n';
+            return;
         }
         
-        // Refer record (if external references exist)
-        if (!cs.extRef.empty()) {
-            file << "R";
-            for (const auto& symbol : cs.extRef) {
-                file << "^" << setw(6) << left << symbol;
-            }
-            file << endl;
-        }
+        file.hex(line.address, 4);
+        file << '\t';
+        file.pad(line.label, 8);
+        file << '\t';
+        file.pad(line.opcode, 8);
+        file << '\t';
+        file.pad(line.operand, 12);
+        file << '\t';
+        leftAligned = true;
         
-        // Text records
-        for (const auto& textRecord : textRecords) {
-            // Check if this text record belongs to current control section
-            if (textRecord.controlSection != cs.name) continue;
-            
-            file << "T^" << intToHex(textRecord.startAddress, 6) << "^";
-            
-            // Calculate total length
-            int totalLength = 0;
-            for (const auto& objCode : textRecord.objectCodes) {
-                totalLength += objCode.length() / 2; // Convert hex chars to bytes
-            }
-            file << intToHex(totalLength, 2) << "^";
-            
-            // Object codes
-            for (size_t i = 0; i < textRecord.objectCodes.size(); ++i) {
-                if (i > 0) file << "^";
-                file << textRecord.objectCodes[i];
-            }
-            file << endl;
-        }
+        size_t digits = line.codeLength * 2;
+        char* code = file.reserve(max<size_t>(digits, 12));
+        encodeHex(objectCodeOf(line), line.codeLength, code);
+        if (digits < 12) memset(code + digits, ' ', 12 - digits);
+        file << '\t' << line.comment << '\n';
+    });
+}
+
+// The object program as the object file formats see it
+void SICXEAssembler::buildObjectModule(ObjectModule& module) {
+    module.sections.clear();
+    module.sections.resize(controlSections.size());
+    
+    for (size_t section = 0; section < controlSections.size(); ++section) {
+        const ControlSection& cs = controlSections[section];
+        ObjectSection& object = module.sections[section];
+        object.name = cs.name;
+        object.startAddress = cs.startAddress;
+        object.length = cs.length;
         
-        // Modification records
-        for (const auto& modRecord : modificationRecords) {
-            // Check if this modification record belongs to current control section
-            // by finding the exact instruction that generated this modification record
-            bool belongsToCS = false;
-            for (const auto& line : sourceLines) {
-                if (line.controlSection == cs.name) {
-                    // For Format 4 instructions, modification record address = instruction address + 1
-                    if (modRecord.length == 5 && line.address + 1 == modRecord.address && 
-                        !line.opcode.empty() && line.opcode[0] == '+') {
-                        belongsToCS = true;
-                        break;
-                    }
-                    // For WORD directives, modification record address = instruction address
-                    else if (modRecord.length == 6 && line.address == modRecord.address && 
-                             line.opcode == "WORD") {
-                        belongsToCS = true;
-                        break;
-                    }
-                }
-            }
-            
-            if (!belongsToCS) continue;
-            
-            file << "M^" << intToHex(modRecord.address, 6) << "^";
-            file << intToHex(modRecord.length, 2) << "^";
-            file << (modRecord.isAddition ? "+" : "-");
-            file << modRecord.symbol << endl;
+        for (const auto& symbol : cs.extDef) {
+            auto entry = symbolTable.find(symbol);
+            object.definitions.emplace_back(symbol, entry != symbolTable.end() ? entry->second.address : 0);
         }
+        object.references = cs.extRef;
+        object.texts = textRecords[section];
+        object.modifications = modificationRecords[section];
+        object.code = objectBytes[section + 1];
         
-        // End record
-        file << "E";
         if (cs.name == controlSections[0].name) { // First control section
             // Find first executable instruction address
             for (const auto& line : sourceLines) {
                 if (line.controlSection == cs.name && !line.opcode.empty() && 
-                    line.opcode != "START" && line.opcode != "RESW" && 
-                    line.opcode != "RESB" && line.opcode != "WORD" && 
-                    line.opcode != "BYTE") {
-                    file << "^" << intToHex(line.address, 6);
+                    line.op != Opcode::START && line.op != Opcode::RESW && 
+                    line.op != Opcode::RESB && line.op != Opcode::WORD && 
+                    line.op != Opcode::BYTE) {
+                    object.hasEntry = true;
+                    object.entryAddress = line.address;
                     break;
                 }
             }
         }
-        file << endl;
     }
-    
-    file.close();
-    cout << "Object file generated: " << filename << endl;
 }
 
-void SICXEAssembler::printSymbolTable() {
-    cout << "\nSymbol Table:" << endl;
-    cout << "Symbol\t\tAddress\t\tControl Section\tExternal" << endl;
-    cout << "------\t\t-------\t\t---------------\t--------" << endl;
+bool SICXEAssembler::generateObjectFile(const string& filename, ObjectFormat format) {
+    ObjectModule module;
+    buildObjectModule(module);
+    formatObjectFile(module, format);
+    return objectOutput.writeTo(filename);
+}
+
+void SICXEAssembler::formatObjectFile(const ObjectModule& module, ObjectFormat format) {
+    OutputBuffer& file = objectOutput;
+    file.clear();
+    if (format == ObjectFormat::BINARY) {
+        writeObjectBinary(module, file);
+    } else {
+        writeObjectText(module, file);
+    }
+}
+
+void SICXEAssembler::printSymbolTable(ostream& out) {
+    if (fromCache) {
+        out << cachedTables.symbols;
+        return;
+    }
+    out << "\nSymbol Table:" << endl;
+    out << "Symbol\t\tAddress\t\tControl Section\tExternal" << endl;
+    out << "------\t\t-------\t\t---------------\t--------" << endl;
     
     for (const auto& symbol : symbolTable) {
-        cout << setw(8) << left << symbol.first << "\t";
-        cout << intToHex(symbol.second.address, 4) << "\t\t";
-        cout << setw(12) << left << symbol.second.controlSection << "\t";
-        cout << (symbol.second.isExternal ? "Yes" : "No") << endl;
+        out << setw(8) << left << symbol.first << "\t";
+        out << intToHex(symbol.second.address, 4) << "\t\t";
+        out << setw(12) << left << symbol.second.controlSection << "\t";
+        out << (symbol.second.isExternal ? "Yes" : "No") << endl;
     }
 }
 
-void SICXEAssembler::printControlSections() {
-    cout << "\nControl Sections:" << endl;
-    cout << "Name\t\tStart Address\tLength\tEXTREF" << endl;
-    cout << "----\t\t-------------\t------\t------" << endl;
+void SICXEAssembler::printControlSections(ostream& out) {
+    if (fromCache) {
+        out << cachedTables.sections;
+        return;
+    }
+    out << "\nControl Sections:" << endl;
+    out << "Name\t\tStart Address\tLength\tEXTREF" << endl;
+    out << "----\t\t-------------\t------\t------" << endl;
     
     for (const auto& cs : controlSections) {
-        cout << setw(8) << left << cs.name << "\t";
-        cout << intToHex(cs.startAddress, 4) << "\t\t";
-        cout << intToHex(cs.length, 4) << "\t";
+        out << setw(8) << left << cs.name << "\t";
+        out << intToHex(cs.startAddress, 4) << "\t\t";
+        out << intToHex(cs.length, 4) << "\t";
         
         // Print EXTREF list
         for (size_t i = 0; i < cs.extRef.size(); ++i) {
-            if (i > 0) cout << ",";
-            cout << cs.extRef[i];
+            if (i > 0) out << ",";
+            out << cs.extRef[i];
         }
-        cout << endl;
+        out << endl;
     }
 }
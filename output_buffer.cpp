@@ -0,0 +1,138 @@
+#include "assembler.h"
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+void OutputBuffer::nextBlock(size_t minimum) {
+    finish();
+    if (active == blocks.size()) {
+        blocks.push_back(Block());
+    }
+    Block& block = blocks[active++];
+    if (!block.data || block.capacity < minimum) {
+        block.capacity = max(minimum, BLOCK_SIZE);
+        block.data.reset(new char[block.capacity]);
+    }
+    block.length = 0;
+    cursor = block.data.get();
+    limit = cursor + block.capacity;
+}
+
+// Record how much of the block being filled is in use
+void OutputBuffer::finish() {
+    if (active > 0) {
+        blocks[active - 1].length = cursor - blocks[active - 1].data.get();
+    }
+}
+
+void OutputBuffer::pad(string_view text, size_t width) {
+    size_t count = max(text.size(), width);
+    if (count == 0) return;
+    char* out = reserve(count);
+    // An empty view may have no data at all
+    if (!text.empty()) memcpy(out, text.data(), text.size());
+    memset(out + text.size(), ' ', count - text.size());
+}
+
+void OutputBuffer::number(int value, int width, bool leftAlign) {
+    char digits[16];
+    size_t length = to_chars(digits, digits + sizeof(digits), value).ptr - digits;
+    size_t count = max(length, size_t(max(width, 0)));
+    char* out = reserve(count);
+    size_t padding = count - length;
+    if (leftAlign) {
+        memcpy(out, digits, length);
+        memset(out + length, ' ', padding);
+    } else {
+        memset(out, ' ', padding);
+        memcpy(out + padding, digits, length);
+    }
+}
+
+void OutputBuffer::hex(int value, int width) {
+    width = min(width, 16);
+    char* out = reserve(16);
+    cursor = formatHex(out, uint32_t(value), width);
+}
+
+size_t OutputBuffer::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i + 1 < active; ++i) {
+        total += blocks[i].length;
+    }
+    if (active > 0) total += cursor - blocks[active - 1].data.get();
+    return total;
+}
+
+// Takes over other's blocks; nothing is copied
+void OutputBuffer::append(OutputBuffer& other) {
+    other.finish();
+    if (other.active == 0) return;
+    finish();
+    
+    auto moved = other.blocks.begin() + other.active;
+    blocks.insert(blocks.begin() + active, make_move_iterator(other.blocks.begin()), make_move_iterator(moved));
+    other.blocks.erase(other.blocks.begin(), moved);
+    active += other.active;
+    other.clear();
+    
+    Block& last = blocks[active - 1];
+    cursor = last.data.get() + last.length;
+    limit = last.data.get() + last.capacity;
+}
+
+void OutputBuffer::copyTo(string& out) {
+    finish();
+    out.clear();
+    out.reserve(size());
+    for (size_t i = 0; i < active; ++i) {
+        out.append(blocks[i].data.get(), blocks[i].length);
+    }
+}
+
+// Keeps the blocks (and their memory) for the next file
+void OutputBuffer::clear() {
+    active = 0;
+    cursor = nullptr;
+    limit = nullptr;
+}
+
+bool OutputBuffer::writeTo(const string& filename) {
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return false;
+    
+    finish();
+    vector<iovec> pending;
+    for (size_t i = 0; i < active; ++i) {
+        if (blocks[i].length > 0) {
+            pending.push_back(iovec{ blocks[i].data.get(), blocks[i].length });
+        }
+    }
+    
+    // Usually a single writev(); loop for short writes and IOV_MAX
+    size_t next = 0;
+    bool ok = true;
+    while (next < pending.size()) {
+        int count = int(min<size_t>(pending.size() - next, IOV_MAX));
+        ssize_t written = writev(fd, pending.data() + next, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        while (next < pending.size() && size_t(written) >= pending[next].iov_len) {
+            written -= pending[next].iov_len;
+            ++next;
+        }
+        if (written > 0) {
+            pending[next].iov_base = static_cast<char*>(pending[next].iov_base) + written;
+            pending[next].iov_len -= written;
+        }
+    }
+    
+    if (::close(fd) != 0) ok = false;
+    return ok;
+}
@@ -1,13 +1,232 @@
 #include "assembler.h"
+#include "thread_pool.h"
 #include <algorithm>
 
+// Programs shorter than this run pass 1 on the calling thread; longer ones
+// are cut at CSECTs into chunks of at least PASS1_CHUNK_LINES lines
+static const size_t PARALLEL_PASS1_MIN = 16384;
+static const size_t PASS1_CHUNK_LINES = 4096;
+
 void SICXEAssembler::pass1() {
+    vector<size_t> bounds;
+    if (sourceLines.size() >= PARALLEL_PASS1_MIN && ThreadPool::shared().size() >= 2) {
+        bounds = pass1Chunks();
+    }
+    if (bounds.size() < 3 || !pass1Sections(bounds)) {
+        clearPass1();
+        pass1Lines(sourceLines.data(), 0, sourceLines.size());
+    }
+    
+    resolveBaseStates();
+}
+
+void SICXEAssembler::clearPass1() {
+    symbolTable.clear();
+    controlSections.clear();
+    literalTable.clear();
+    pendingLiterals.clear();
+    pendingLiteralSet.clear();
+    literalLines.clear();
+    literalPools.clear();
+    symbolIds.clear();
+    symbolNames.clear();
+    baseLines.clear();
     locationCounter = 0;
     currentControlSection = "";
+    currentSection = -1;
+    baseRegister = 0;
+    baseSet = false;
+}
+
+// Chunk boundaries for a parallel pass 1: [bounds[k], bounds[k + 1]) starts
+// at a CSECT that opens a new section (or at line 0)
+vector<size_t> SICXEAssembler::pass1Chunks() {
+    vector<size_t> bounds(1, 0);
+    for (size_t i = 0; i < sourceLines.size(); ++i) {
+        const AssemblyLine& line = sourceLines[i];
+        if (!line.isComment && line.op == Opcode::CSECT && !line.label.empty() &&
+            i - bounds.back() >= PASS1_CHUNK_LINES) {
+            bounds.push_back(i);
+        }
+    }
+    bounds.push_back(sourceLines.size());
+    return bounds;
+}
+
+// Each chunk of control sections runs pass 1 in an assembler of its own,
+// on our lines, into its own tables; they are then merged in program
+// order. A CSECT starts from a fresh location counter, so the chunks only
+// interact through the symbol and literal tables. The merge reproduces
+// what a serial pass does with names a chunk shares with earlier ones: a
+// definition replaces the entry but keeps its external flag, EXTDEF and
+// EXTREF of a known name change nothing. Which literals a chunk finds
+// already placed or still pending follows from the LTORGs and ENDs before
+// it, so each chunk starts with those. Whatever the merge cannot reproduce
+// (a lookup of an earlier chunk's name, a duplicate across chunks) and
+// every error returns false, and pass 1 runs again serially with the
+// usual diagnostics.
+bool SICXEAssembler::pass1Sections(const vector<size_t>& bounds) {
+    size_t chunks = bounds.size() - 1;
+    
+    // Sections opened before each chunk, which numbers its own from there,
+    // the literals already placed and those still waiting for a pool
+    vector<size_t> sectionsBefore(chunks, 0);
+    vector<vector<string_view>> placedBefore(chunks);
+    vector<vector<string_view>> pendingBefore(chunks);
+    size_t sections = 0;
+    vector<string_view> placed;
+    unordered_set<string_view> placedSet;
+    vector<string_view> pending;
+    unordered_set<string_view> pendingSet;
+    for (size_t k = 0; k < chunks; ++k) {
+        sectionsBefore[k] = sections;
+        placedBefore[k] = placed;
+        pendingBefore[k] = pending;
+        for (size_t i = bounds[k]; i < bounds[k + 1]; ++i) {
+            const AssemblyLine& line = sourceLines[i];
+            if (line.isComment || line.opcode.empty()) continue;
+            if (!line.label.empty() && (line.op == Opcode::START || line.op == Opcode::CSECT)) {
+                ++sections;
+            } else if (line.op == Opcode::LTORG || line.op == Opcode::END) {
+                for (string_view literal : pending) {
+                    if (placedSet.insert(literal).second) placed.push_back(literal);
+                }
+                pending.clear();
+                pendingSet.clear();
+            } else if ((!line.instruction || !line.instruction->isDirective()) &&
+                       !line.operand.empty() && line.operand[0] == '=' && pendingSet.insert(line.operand).second) {
+                pending.push_back(line.operand);
+            }
+        }
+    }
     
-    for (auto& line : sourceLines) {
+    vector<SICXEAssembler> workers(chunks);
+    vector<Pass1Trace> traces(chunks);
+    vector<char> failed(chunks, 0);
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(chunks, [&](size_t k) {
+        SICXEAssembler& worker = workers[k];
+        worker.trace = &traces[k];
+        worker.controlSections.resize(sectionsBefore[k]);
+        worker.pendingLiterals = pendingBefore[k];
+        worker.pendingLiteralSet.insert(pendingBefore[k].begin(), pendingBefore[k].end());
+        for (string_view literal : placedBefore[k]) {
+            worker.literalTable.emplace(literal, 0);  // address filled in after the merge
+        }
+        try {
+            worker.pass1Lines(sourceLines.data(), bounds[k], bounds[k + 1]);
+        } catch (...) {
+            failed[k] = 1;
+        }
+    });
+    
+    clearPass1();
+    vector<vector<int>> ids(chunks);
+    vector<size_t> firstLiteral(chunks + 1, 0);
+    vector<size_t> basesBefore(chunks, 0);
+    for (size_t k = 0; k < chunks; ++k) {
+        SICXEAssembler& worker = workers[k];
+        if (failed[k]) return false;
+        for (const auto& literal : worker.literalTable) {
+            if (!literalTable.count(literal.first) && symbolTable.count(literal.first)) return false;
+        }
+        for (string_view name : traces[k].earlyLookups) {
+            if (symbolTable.count(name)) return false;
+        }
+        
+        // The CSECT that opens this chunk closes the section before it
+        if (k > 0 && !controlSections.empty()) {
+            controlSections.back().length = workers[k - 1].locationCounter - controlSections.back().startAddress;
+        }
+        
+        // New names move over; the ones left behind were known already
+        symbolTable.merge(worker.symbolTable);
+        for (auto& entry : worker.symbolTable) {
+            auto definition = traces[k].definitions.find(entry.first);
+            if (definition == traces[k].definitions.end()) continue;
+            Symbol& known = symbolTable.find(entry.first)->second;
+            if (definition->second.first && known.isDefined &&
+                known.controlSection == definition->second.second) {
+                return false;
+            }
+            bool external = known.isExternal;
+            known = move(entry.second);
+            known.isExternal = external;
+        }
+        
+        literalTable.merge(worker.literalTable);
+        for (size_t s = sectionsBefore[k]; s < worker.controlSections.size(); ++s) {
+            controlSections.push_back(move(worker.controlSections[s]));
+        }
+        firstLiteral[k] = literalLines.size();
+        for (const LiteralPool& placed : worker.literalPools) {
+            literalPools.push_back(LiteralPool(placed.line, placed.first + firstLiteral[k], placed.last + firstLiteral[k]));
+        }
+        move(worker.literalLines.begin(), worker.literalLines.end(), back_inserter(literalLines));
+        basesBefore[k] = baseLines.size();
+        baseLines.insert(baseLines.end(), worker.baseLines.begin(), worker.baseLines.end());
+        if (traces[k].setsBase) {
+            baseRegister = worker.baseRegister;
+            baseSet = worker.baseSet;
+        }
+        
+        // Interning chunk by chunk gives the ids a serial pass would
+        for (string_view name : worker.symbolNames) {
+            ids[k].push_back(internSymbol(name));
+        }
+    }
+    firstLiteral[chunks] = literalLines.size();
+    
+    const SICXEAssembler& last = workers.back();
+    locationCounter = last.locationCounter;
+    currentControlSection = last.currentControlSection;
+    currentSection = last.currentSection;
+    pendingLiterals = last.pendingLiterals;
+    pendingLiteralSet = last.pendingLiteralSet;
+    
+    // Operand ids and BASE ordinals were numbered within the chunk, and
+    // pool entries for literals placed by earlier chunks need their address
+    pool.parallelFor(chunks, [&](size_t k) {
+        for (size_t i = bounds[k]; i < bounds[k + 1]; ++i) {
+            AssemblyLine& line = sourceLines[i];
+            if (line.isComment) continue;
+            line.decodedOperand.symbol = ids[k][line.decodedOperand.symbol];
+            line.baseState += basesBefore[k];
+        }
+        for (size_t i = firstLiteral[k]; i < firstLiteral[k + 1]; ++i) {
+            AssemblyLine& line = literalLines[i];
+            line.decodedOperand.symbol = ids[k][line.decodedOperand.symbol];
+            line.address = literalTable.find(line.operand)->second;
+        }
+    });
+    return true;
+}
+
+// Lookups and definitions that may involve names of earlier chunks
+void SICXEAssembler::traceLookup(string_view name) {
+    if (!trace) return;
+    auto entry = symbolTable.find(name);
+    if (entry == symbolTable.end() || !entry->second.isDefined) {
+        trace->earlyLookups.push_back(name);
+    }
+}
+
+void SICXEAssembler::traceDefinition(string_view name, bool label) {
+    if (trace) {
+        trace->definitions.emplace(name, make_pair(label, currentControlSection));
+    }
+}
+
+// Pass 1 proper over lines [begin, end) of 'lines', the source lines of
+// the assembly being run (ours, or the parent's for a chunk)
+void SICXEAssembler::pass1Lines(AssemblyLine* lines, size_t begin, size_t end) {
+    lineOrigin = lines;
+    for (size_t i = begin; i < end; ++i) {
+        AssemblyLine& line = lines[i];
         if (line.isComment) continue;
         
+        decodeOperand(line);
+        
         // Process directives first to handle control section changes
         if (!line.opcode.empty()) {
             processDirective(line);
@@ -15,55 +234,67 @@ void SICXEAssembler::pass1() {
         
         // Assign control section after processing directives (so CSECT updates are reflected)
         line.controlSection = currentControlSection;
+        line.section = currentSection;
+        
+        // Every line remembers the latest BASE; its operand may be a forward
+        // reference, so the register value is resolved after the loop
+        if (line.op == Opcode::BASE) {
+            baseLines.push_back(i);
+        }
+        line.baseState = baseLines.size();
         
         // Assign addresses after processing directives (so CSECT gets address 0)
         // Don't assign addresses to directives that don't consume memory
-        if (line.opcode != "BASE" && line.opcode != "NOBASE" && 
-            line.opcode != "EXTDEF" && line.opcode != "EXTREF" && line.opcode != "USE") {
+        if (line.op != Opcode::BASE && line.op != Opcode::NOBASE && 
+            line.op != Opcode::EXTDEF && line.op != Opcode::EXTREF && line.op != Opcode::USE) {
             line.address = locationCounter;
         }
         
         // Add label to symbol table (skip if already processed by directive like EQU)
-        if (!line.label.empty() && line.opcode != "EQU" && symbolTable.find(line.label) == symbolTable.end()) {
-            symbolTable[line.label] = Symbol(locationCounter, currentControlSection);
-        } else if (!line.label.empty() && line.opcode != "EQU") {
+        if (!line.label.empty() && line.op != Opcode::EQU) {
+            traceDefinition(line.label, true);
+        }
+        if (!line.label.empty() && line.op != Opcode::EQU && symbolTable.find(line.label) == symbolTable.end()) {
+            symbolTable[string(line.label)] = Symbol(locationCounter, currentControlSection);
+        } else if (!line.label.empty() && line.op != Opcode::EQU) {
             // Check for duplicate symbol definition within the same control section
             auto existing = symbolTable.find(line.label);
             if (existing != symbolTable.end()) {
                 if (existing->second.isDefined && existing->second.controlSection == currentControlSection) {
                     // Duplicate symbol error - only if already defined in same control section
-                    cerr << "Error on line " << line.lineNumber << ": Duplicate symbol definition '" 
-                         << line.label << "'" << endl;
-                    cerr << "Symbol '" << line.label << "' was already defined in control section '" 
-                         << existing->second.controlSection << "'" << endl;
-                    exit(1);
+                    ostringstream error;
+                    error << "Error on line " << line.lineNumber << ": Duplicate symbol definition '" 
+                          << line.label << "'" << endl;
+                    error << "Symbol '" << line.label << "' was already defined in control section '" 
+                          << existing->second.controlSection << "'" << endl;
+                    throw AssemblyError(error.str());
                 } else if (!existing->second.isDefined || existing->second.controlSection != currentControlSection) {
                     // Update placeholder symbol (from EXTDEF/EXTREF) or allow symbol in different control section
-                    symbolTable[line.label] = Symbol(locationCounter, currentControlSection, existing->second.isExternal, true);
+                    existing->second = Symbol(locationCounter, currentControlSection, existing->second.isExternal, true);
                 }
             }
         }
         
         // Process instructions after address assignment
+        // (the other directives were fully handled by processDirective)
         if (!line.opcode.empty()) {
-            if (line.opcode != "START" && line.opcode != "END" && line.opcode != "CSECT" &&
-                line.opcode != "EXTDEF" && line.opcode != "EXTREF" && line.opcode != "BASE" &&
-                line.opcode != "NOBASE" && line.opcode != "EQU" && line.opcode != "ORG" && 
-                line.opcode != "LTORG" && line.opcode != "USE") {
+            if (!line.instruction || !line.instruction->isDirective() ||
+                line.op == Opcode::RESW || line.op == Opcode::RESB ||
+                line.op == Opcode::WORD || line.op == Opcode::BYTE) {
                 // Handle RESW, RESB, WORD, and BYTE here (after address assignment)
-                if (line.opcode == "RESW") {
+                if (line.op == Opcode::RESW) {
                     if (!line.operand.empty()) {
-                        int words = stoi(line.operand);
+                        int words = stoi(string(line.operand));
                         locationCounter += words * 3;
                     }
-                } else if (line.opcode == "RESB") {
+                } else if (line.op == Opcode::RESB) {
                     if (!line.operand.empty()) {
-                        int bytes = stoi(line.operand);
+                        int bytes = stoi(string(line.operand));
                         locationCounter += bytes;
                     }
-                } else if (line.opcode == "WORD") {
+                } else if (line.op == Opcode::WORD) {
                     locationCounter += 3;
-                } else if (line.opcode == "BYTE") {
+                } else if (line.op == Opcode::BYTE) {
                     if (!line.operand.empty()) {
                         if (line.operand[0] == 'C') {
                             // Character constant
@@ -71,7 +302,7 @@ void SICXEAssembler::pass1() {
                             locationCounter += length;
                         } else if (line.operand[0] == 'X') {
                             // Hexadecimal constant - count hex digits and divide by 2
-                            string hexDigits = line.operand.substr(2, line.operand.length() - 3); // Remove X' and '
+                            string_view hexDigits = line.operand.substr(2, line.operand.length() - 3); // Remove X' and '
                             int length = (hexDigits.length() + 1) / 2; // Round up for odd number of hex digits
                             locationCounter += length;
                         }
@@ -82,25 +313,41 @@ void SICXEAssembler::pass1() {
             }
         }
     }
-    
-    // Insert literal lines after LTORG directives
-    insertLiteralLines();
+}
+
+// The base register pass 2 encodes each line with: pass 1's final state up
+// to the first BASE, then what the latest BASE naming a known symbol loaded.
+// Precomputing it here keeps object code generation free of running state.
+void SICXEAssembler::resolveBaseStates() {
+    baseStates.assign(1, BaseState(baseRegister, baseSet));
+    for (size_t index : baseLines) {
+        BaseState base = baseStates.back();
+        const AssemblyLine& line = sourceLines[index];
+        if (!line.operand.empty()) {
+            auto symbol = symbolTable.find(line.decodedOperand.name);
+            if (symbol != symbolTable.end()) {
+                base = BaseState(symbol->second.address, true);
+            }
+        }
+        baseStates.push_back(base);
+    }
 }
 
 void SICXEAssembler::processDirective(AssemblyLine& line) {
-    string opcode = line.opcode;
-    string operand = line.operand;
+    Opcode opcode = line.op;
+    string_view operand = line.operand;
     
-    if (opcode == "START") {
+    if (opcode == Opcode::START) {
         if (!operand.empty()) {
             locationCounter = hexToDecimal(operand);
         }
         if (!line.label.empty()) {
             currentControlSection = line.label;
+            currentSection = controlSections.size();
             controlSections.push_back(ControlSection(line.label, locationCounter));
         }
     }
-    else if (opcode == "CSECT") {
+    else if (opcode == Opcode::CSECT) {
         // Update current control section length
         if (!controlSections.empty()) {
             controlSections.back().length = locationCounter - controlSections.back().startAddress;
@@ -109,37 +356,15 @@ void SICXEAssembler::processDirective(AssemblyLine& line) {
         // Start new control section
         if (!line.label.empty()) {
             currentControlSection = line.label;
+            currentSection = controlSections.size();
             controlSections.push_back(ControlSection(line.label, 0));
             locationCounter = 0;
         }
     }
-    else if (opcode == "END") {
+    else if (opcode == Opcode::END) {
         // If there are pending literals, create an automatic literal pool
         if (!pendingLiterals.empty()) {
-            // Store which literals should be placed at this END (automatic LTORG)
-            ltorgLiterals[line.lineNumber] = pendingLiterals;
-            
-            // Place literals and advance location counter
-            for (const string& literal : pendingLiterals) {
-                if (literalTable.find(literal) == literalTable.end()) {
-                    literalTable[literal] = locationCounter;
-                    symbolTable[literal] = Symbol(locationCounter, currentControlSection);
-                    
-                    // Calculate literal size and advance location counter
-                    if (literal.substr(0, 2) == "=C") {
-                        int length = literal.length() - 4; // Remove =C' and '
-                        locationCounter += length;
-                    } else if (literal.substr(0, 2) == "=X") {
-                        int length = (literal.length() - 4) / 2; // Remove =X' and ', divide by 2
-                        locationCounter += length;
-                    } else {
-                        locationCounter += 3; // Default to 3 bytes
-                    }
-                }
-            }
-            
-            // Clear pending literals - they're now placed
-            pendingLiterals.clear();
+            placeLiteralPool(line);
         }
         
         // Update current control section length
@@ -147,37 +372,41 @@ void SICXEAssembler::processDirective(AssemblyLine& line) {
             controlSections.back().length = locationCounter - controlSections.back().startAddress;
         }
     }
-    else if (opcode == "EXTDEF") {
+    else if (opcode == Opcode::EXTDEF) {
         if (!controlSections.empty()) {
-            vector<string> symbols = split(operand, ',');
-            for (const string& symbol : symbols) {
-                string trimmedSymbol = trim(symbol);
-                controlSections.back().extDef.push_back(trimmedSymbol);
+            vector<string_view> symbols = split(operand, ',');
+            for (string_view symbol : symbols) {
+                string_view trimmedSymbol = trim(symbol);
+                controlSections.back().extDef.push_back(string(trimmedSymbol));
                 // Create placeholder for EXTDEF symbol - will be updated when actually defined
                 // Don't mark as external since these are local symbols being exported
                 if (symbolTable.find(trimmedSymbol) == symbolTable.end()) {
-                    symbolTable[trimmedSymbol] = Symbol(0, currentControlSection, false, false);
+                    symbolTable[string(trimmedSymbol)] = Symbol(0, currentControlSection, false, false);
                 }
             }
         }
     }
-    else if (opcode == "EXTREF") {
+    else if (opcode == Opcode::EXTREF) {
         if (!controlSections.empty()) {
-            vector<string> symbols = split(operand, ',');
-            for (const string& symbol : symbols) {
-                string trimmedSymbol = trim(symbol);
-                controlSections.back().extRef.push_back(trimmedSymbol);
+            vector<string_view> symbols = split(operand, ',');
+            for (string_view symbol : symbols) {
+                string_view trimmedSymbol = trim(symbol);
+                controlSections.back().extRef.push_back(string(trimmedSymbol));
+                controlSections.back().extRefSet.insert(trimmedSymbol);
                 // Only add as external reference if not already defined in another section
                 if (symbolTable.find(trimmedSymbol) == symbolTable.end()) {
-                    symbolTable[trimmedSymbol] = Symbol(0, currentControlSection, true, false);
+                    symbolTable[string(trimmedSymbol)] = Symbol(0, currentControlSection, true, false);
                 }
             }
         }
     }
-    else if (opcode == "BASE") {
+    else if (opcode == Opcode::BASE) {
         if (!operand.empty()) {
-            if (symbolTable.find(operand) != symbolTable.end()) {
-                baseRegister = symbolTable[operand].address;
+            traceLookup(operand);
+            if (trace) trace->setsBase = true;
+            auto baseSymbol = symbolTable.find(operand);
+            if (baseSymbol != symbolTable.end()) {
+                baseRegister = baseSymbol->second.address;
                 baseSet = true;
             } else {
                 // Symbol not found yet, will be resolved in Pass 2
@@ -185,225 +414,250 @@ void SICXEAssembler::processDirective(AssemblyLine& line) {
             }
         }
     }
-    else if (opcode == "NOBASE") {
+    else if (opcode == Opcode::NOBASE) {
+        if (trace) trace->setsBase = true;
         baseSet = false;
         baseRegister = 0;
     }
     // RESW, RESB, WORD, and BYTE are handled after address assignment to avoid interfering with symbol addresses
-    else if (opcode == "EQU") {
+    else if (opcode == Opcode::EQU) {
         // Handle EQU directive - symbol value is defined by operand
         if (!line.label.empty() && !operand.empty()) {
+            traceDefinition(line.label, false);
             if (operand == "*") {
                 // Current location counter
                 // Check if symbol already exists (e.g., from EXTDEF)
                 auto existing = symbolTable.find(line.label);
                 if (existing != symbolTable.end()) {
                     // Update existing symbol with current location
-                    symbolTable[line.label] = Symbol(locationCounter, currentControlSection, existing->second.isExternal, true);
+                    existing->second = Symbol(locationCounter, currentControlSection, existing->second.isExternal, true);
                 } else {
-                    symbolTable[line.label] = Symbol(locationCounter, currentControlSection);
+                    symbolTable[string(line.label)] = Symbol(locationCounter, currentControlSection);
                 }
             } else {
                 // Try to evaluate operand as number or expression
                 try {
-                    int value = stoi(operand);
+                    int value = stoi(string(operand));
                     // Check if symbol already exists (e.g., from EXTDEF)
                     auto existing = symbolTable.find(line.label);
                     if (existing != symbolTable.end()) {
-                        symbolTable[line.label] = Symbol(value, currentControlSection, existing->second.isExternal, true);
+                        symbolTable[string(line.label)] = Symbol(value, currentControlSection, existing->second.isExternal, true);
                     } else {
-                        symbolTable[line.label] = Symbol(value, currentControlSection);
+                        symbolTable[string(line.label)] = Symbol(value, currentControlSection);
                     }
                 } catch (...) {
                     // Handle expressions like BUFEND-BUFFER
-                    if (operand.find('-') != string::npos) {
-                        vector<string> parts = split(operand, '-');
+                    if (operand.find('-') != string_view::npos) {
+                        vector<string_view> parts = split(operand, '-');
                         if (parts.size() == 2) {
-                            string symbol1 = trim(parts[0]);
-                            string symbol2 = trim(parts[1]);
+                            string_view symbol1 = trim(parts[0]);
+                            string_view symbol2 = trim(parts[1]);
+                            traceLookup(symbol1);
+                            traceLookup(symbol2);
                             
                             // Validate that both symbols exist or are external references
                             bool symbol1Valid = (symbolTable.find(symbol1) != symbolTable.end()) || 
-                                               isExternalReference(symbol1, currentControlSection);
+                                               isExternalReference(symbol1, currentSection);
                             bool symbol2Valid = (symbolTable.find(symbol2) != symbolTable.end()) || 
-                                               isExternalReference(symbol2, currentControlSection);
+                                               isExternalReference(symbol2, currentSection);
                             
                             if (!symbol1Valid) {
-                                cerr << "Error on line " << line.lineNumber << ": Undefined symbol '" 
-                                     << symbol1 << "' in EQU expression" << endl;
-                                exit(1);
+                                ostringstream error;
+                                error << "Error on line " << line.lineNumber << ": Undefined symbol '" 
+                                      << symbol1 << "' in EQU expression" << endl;
+                                throw AssemblyError(error.str());
                             }
                             if (!symbol2Valid) {
-                                cerr << "Error on line " << line.lineNumber << ": Undefined symbol '" 
-                                     << symbol2 << "' in EQU expression" << endl;
-                                exit(1);
+                                ostringstream error;
+                                error << "Error on line " << line.lineNumber << ": Undefined symbol '" 
+                                      << symbol2 << "' in EQU expression" << endl;
+                                throw AssemblyError(error.str());
                             }
                             
                             // Calculate value if both symbols are defined
                             if (symbolTable.find(symbol1) != symbolTable.end() && 
                                 symbolTable.find(symbol2) != symbolTable.end()) {
-                                int value = symbolTable[symbol1].address - symbolTable[symbol2].address;
+                                int value = symbolTable.find(symbol1)->second.address - symbolTable.find(symbol2)->second.address;
                                 auto existing = symbolTable.find(line.label);
                                 if (existing != symbolTable.end()) {
-                                    symbolTable[line.label] = Symbol(value, currentControlSection, existing->second.isExternal, true);
+                                    symbolTable[string(line.label)] = Symbol(value, currentControlSection, existing->second.isExternal, true);
                                 } else {
-                                    symbolTable[line.label] = Symbol(value, currentControlSection);
+                                    symbolTable[string(line.label)] = Symbol(value, currentControlSection);
                                 }
                             } else {
                                 // One or both are external - set to 0 for now
                                 auto existing = symbolTable.find(line.label);
                                 if (existing != symbolTable.end()) {
-                                    symbolTable[line.label] = Symbol(0, currentControlSection, existing->second.isExternal, true);
+                                    symbolTable[string(line.label)] = Symbol(0, currentControlSection, existing->second.isExternal, true);
                                 } else {
-                                    symbolTable[line.label] = Symbol(0, currentControlSection);
+                                    symbolTable[string(line.label)] = Symbol(0, currentControlSection);
                                 }
                             }
                         } else {
-                            cerr << "Error on line " << line.lineNumber << ": Invalid expression '" 
-                                 << operand << "' in EQU directive" << endl;
-                            exit(1);
+                            ostringstream error;
+                            error << "Error on line " << line.lineNumber << ": Invalid expression '" 
+                                  << operand << "' in EQU directive" << endl;
+                            throw AssemblyError(error.str());
                         }
                     } else {
                         // Single symbol reference
+                        traceLookup(operand);
                         if (symbolTable.find(operand) != symbolTable.end()) {
                             auto existing = symbolTable.find(line.label);
                             if (existing != symbolTable.end()) {
-                                symbolTable[line.label] = Symbol(symbolTable[operand].address, currentControlSection, existing->second.isExternal, true);
+                                symbolTable[string(line.label)] = Symbol(symbolTable.find(operand)->second.address, currentControlSection, existing->second.isExternal, true);
                             } else {
-                                symbolTable[line.label] = Symbol(symbolTable[operand].address, currentControlSection);
+                                symbolTable[string(line.label)] = Symbol(symbolTable.find(operand)->second.address, currentControlSection);
                             }
-                        } else if (isExternalReference(operand, currentControlSection)) {
+                        } else if (isExternalReference(operand, currentSection)) {
                             auto existing = symbolTable.find(line.label);
                             if (existing != symbolTable.end()) {
-                                symbolTable[line.label] = Symbol(0, currentControlSection, existing->second.isExternal, true);
+                                symbolTable[string(line.label)] = Symbol(0, currentControlSection, existing->second.isExternal, true);
                             } else {
-                                symbolTable[line.label] = Symbol(0, currentControlSection);
+                                symbolTable[string(line.label)] = Symbol(0, currentControlSection);
                             }
                         } else {
-                            cerr << "Error on line " << line.lineNumber << ": Undefined symbol '" 
-                                 << operand << "' in EQU directive" << endl;
-                            cerr << "Symbol '" << operand << "' must be defined before use or declared in EXTREF" << endl;
-                            exit(1);
+                            ostringstream error;
+                            error << "Error on line " << line.lineNumber << ": Undefined symbol '" 
+                                  << operand << "' in EQU directive" << endl;
+                            error << "Symbol '" << operand << "' must be defined before use or declared in EXTREF" << endl;
+                            throw AssemblyError(error.str());
                         }
                     }
                 }
             }
         }
     }
-    else if (opcode == "LTORG") {
+    else if (opcode == Opcode::LTORG) {
         // Mark this location for literal pool placement and advance location counter
         line.address = locationCounter; // LTORG gets current address for reference
         
-        // Store which literals should be placed at this LTORG
-        ltorgLiterals[line.lineNumber] = pendingLiterals;
-        
-        // Place literals and advance location counter
-        for (const string& literal : pendingLiterals) {
-            if (literalTable.find(literal) == literalTable.end()) {
-                literalTable[literal] = locationCounter;
-                symbolTable[literal] = Symbol(locationCounter, currentControlSection);
-                
-                // Calculate literal size and advance location counter
-                if (literal.substr(0, 2) == "=C") {
-                    int length = literal.length() - 4; // Remove =C' and '
-                    locationCounter += length;
-                } else if (literal.substr(0, 2) == "=X") {
-                    int length = (literal.length() - 4) / 2; // Remove =X' and ', divide by 2
-                    locationCounter += length;
-                } else {
-                    locationCounter += 3; // Default to 3 bytes
-                }
-            }
-        }
-        
-        // Clear pending literals - they're now placed
-        pendingLiterals.clear();
+        placeLiteralPool(line);
     }
-    else if (opcode == "USE") {
+    else if (opcode == Opcode::USE) {
         // Program blocks are not supported - throw an error
-        cerr << "Error on line " << line.lineNumber << ": USE directive (program blocks) not supported" << endl;
-        cerr << "This assembler does not support program blocks. Please remove USE directives." << endl;
-        exit(1);
+        ostringstream error;
+        error << "Error on line " << line.lineNumber << ": USE directive (program blocks) not supported" << endl;
+        error << "This assembler does not support program blocks. Please remove USE directives." << endl;
+        throw AssemblyError(error.str());
     }
-    else if (opcode == "ORG") {
+    else if (opcode == Opcode::ORG) {
         // ORG directive is not fully implemented - throw an error
-        cerr << "Error on line " << line.lineNumber << ": ORG directive not supported" << endl;
-        cerr << "This assembler does not support the ORG directive for changing location counter." << endl;
-        exit(1);
+        ostringstream error;
+        error << "Error on line " << line.lineNumber << ": ORG directive not supported" << endl;
+        error << "This assembler does not support the ORG directive for changing location counter." << endl;
+        throw AssemblyError(error.str());
     }
 }
 
 void SICXEAssembler::processInstruction(AssemblyLine& line) {
-    string opcode = line.opcode;
-    string operand = line.operand;
+    string_view operand = line.operand;
     
     // Check for literals in operand and add to pending literals
     if (!operand.empty() && operand[0] == '=') {
         // This is a literal
-        if (find(pendingLiterals.begin(), pendingLiterals.end(), operand) == pendingLiterals.end()) {
+        if (pendingLiteralSet.insert(operand).second) {
             pendingLiterals.push_back(operand);
         }
     }
     
-    // Handle extended format (+ prefix)
-    bool isExtended = false;
-    if (opcode[0] == '+') {
-        isExtended = true;
-        opcode = opcode.substr(1);
-    }
-    
-    if (instructionTable.find(opcode) != instructionTable.end()) {
-        int size = getInstructionSize(opcode, operand);
-        if (isExtended && instructionTable[opcode].format == 3) {
+    if (line.instruction) {
+        int size = line.instruction->format;
+        if (line.extended && size == 3) {
             size = 4; // Extended format
         }
         locationCounter += size;
     } else {
         // Invalid opcode error
-        cerr << "Error on line " << line.lineNumber << ": Invalid opcode '" << opcode << "'" << endl;
-        cerr << "Opcode '" << opcode << "' is not a valid SIC/XE instruction" << endl;
-        exit(1);
+        string_view opcode = line.extended ? line.opcode.substr(1) : line.opcode;
+        ostringstream error;
+        error << "Error on line " << line.lineNumber << ": Invalid opcode '" << opcode << "'" << endl;
+        error << "Opcode '" << opcode << "' is not a valid SIC/XE instruction" << endl;
+        throw AssemblyError(error.str());
     }
 }
 
-int SICXEAssembler::getInstructionSize(const string& opcode, const string& operand) {
-    if (instructionTable.find(opcode) != instructionTable.end()) {
-        return instructionTable[opcode].format;
+// Decode the operand field once for pass 2: addressing flags, the bare
+// operand name (interned), its numeric value and format 2 registers
+void SICXEAssembler::decodeOperand(AssemblyLine& line) {
+    Operand& decoded = line.decodedOperand;
+    string_view operand = line.operand;
+    
+    decoded.immediate = isImmediate(operand);
+    decoded.indirect = isIndirect(operand);
+    decoded.indexed = isIndexed(operand);
+    decoded.literal = !operand.empty() && operand[0] == '=';
+    
+    // WORD and BASE refer to their operand exactly as written
+    if (line.op == Opcode::WORD || line.op == Opcode::BASE || operand.empty()) {
+        decoded.name = operand;
+    } else {
+        decoded.name = getBaseOperand(operand);
+    }
+    decoded.isConstant = parseDecimal(decoded.name, decoded.value);
+    decoded.isRegister = isRegisterName(decoded.name);
+    decoded.symbol = internSymbol(decoded.name);
+    
+    if (line.instruction && line.instruction->format == 2) {
+        vector<string_view> registers = split(operand, ',');
+        decoded.validRegisters = true;
+        for (size_t i = 0; i < registers.size(); ++i) {
+            int number = registerNumber(registers[i]);
+            if (number < 0) decoded.validRegisters = false;
+            if (i < 2) decoded.registers[i] = (int8_t)number;
+        }
     }
-    return 0;
 }
 
-void SICXEAssembler::insertLiteralLines() {
-    vector<AssemblyLine> newSourceLines;
+int SICXEAssembler::internSymbol(string_view name) {
+    auto inserted = symbolIds.emplace(name, (int)symbolNames.size());
+    if (inserted.second) {
+        symbolNames.push_back(name);
+    }
+    return inserted.first->second;
+}
+
+// Place the pending literals at an LTORG or END. Literals not placed yet
+// get the next addresses; every pending literal gets a "*" entry listed
+// after this line, carrying the address it was placed at.
+void SICXEAssembler::placeLiteralPool(const AssemblyLine& line) {
+    size_t first = literalLines.size();
     
-    for (const auto& line : sourceLines) {
-        newSourceLines.push_back(line);
-        
-        // If this is an LTORG directive or END directive, insert literal lines after it
-        if (line.opcode == "LTORG" || line.opcode == "END") {
-            // Get the literals that belong to this specific LTORG/END
-            auto ltorgIter = ltorgLiterals.find(line.lineNumber);
-            if (ltorgIter != ltorgLiterals.end()) {
-                const vector<string>& literalsForThisLtorg = ltorgIter->second;
-                
-                // Create literal lines for the listing (literals are already placed in Pass 1)
-                for (const string& literal : literalsForThisLtorg) {
-                    if (literalTable.find(literal) != literalTable.end()) {
-                        // Create a literal line for the listing
-                        AssemblyLine literalLine;
-                        literalLine.lineNumber = line.lineNumber;
-                        literalLine.address = literalTable[literal]; // Use the address from Pass 1
-                        literalLine.label = "*";
-                        literalLine.operand = literal;
-                        literalLine.controlSection = line.controlSection;
-                        literalLine.isComment = false;
-                        
-                        newSourceLines.push_back(literalLine);
-                    }
-                }
+    for (string_view literal : pendingLiterals) {
+        auto placed = literalTable.find(literal);
+        if (placed == literalTable.end()) {
+            placed = literalTable.emplace(literal, locationCounter).first;
+            symbolTable[string(literal)] = Symbol(locationCounter, currentControlSection);
+            
+            // Calculate literal size and advance location counter
+            if (literal.substr(0, 2) == "=C") {
+                int length = literal.length() - 4; // Remove =C' and '
+                locationCounter += length;
+            } else if (literal.substr(0, 2) == "=X") {
+                int length = (literal.length() - 4) / 2; // Remove =X' and ', divide by 2
+                locationCounter += length;
+            } else {
+                locationCounter += 3; // Default to 3 bytes
             }
         }
+        
+        // Entry for the listing and object code (the literal is already placed)
+        AssemblyLine literalLine;
+        literalLine.lineNumber = line.lineNumber;
+        literalLine.address = placed->second;
+        literalLine.label = "*";
+        literalLine.operand = literal;
+        literalLine.controlSection = currentControlSection;
+        literalLine.section = currentSection;
+        literalLine.isComment = false;
+        decodeOperand(literalLine);
+        literalLines.push_back(literalLine);
     }
     
-    sourceLines = newSourceLines;
+    // 'line' is the element of the source lines that pass 1 is processing
+    literalPools.push_back(LiteralPool(&line - lineOrigin, first, literalLines.size()));
+    
+    // Clear pending literals - they're now placed
+    pendingLiterals.clear();
+    pendingLiteralSet.clear();
 }
@@ -1,150 +1,337 @@
 #include "assembler.h"
+#include "thread_pool.h"
 
+namespace {
+
+// Append the low 'count' bytes of value, most significant first
+inline void appendBytes(vector<uint8_t>& code, uint32_t value, int count) {
+    for (int shift = (count - 1) * 8; shift >= 0; shift -= 8) {
+        code.push_back(uint8_t(value >> shift));
+    }
+}
+
+} // namespace
+
+// Programs shorter than this are encoded on the calling thread; longer ones
+// are cut into chunks of PASS2_CHUNK_LINES source lines
+static const size_t PARALLEL_PASS2_MIN = 4096;
+static const size_t PASS2_CHUNK_LINES = 2048;
+
+namespace {
+
+struct EncodeChunk {
+    size_t group;
+    size_t begin;
+    size_t end;
+    vector<uint8_t> code;
+    exception_ptr error;
+
+    EncodeChunk(size_t g, size_t b, size_t e) : group(g), begin(b), end(e) {}
+};
+
+} // namespace
+
+// Control sections only share the finished symbol table, and every line
+// already knows the base register it is encoded with, so any run of lines
+// can be encoded on its own. Each section (objectBytes[section + 1]; lines
+// before START form group 0) is cut into chunks that encode in parallel
+// into private buffers with chunk-relative offsets. The buffers are then
+// joined in order, the offsets shifted, and the section's T and M records
+// built. An error is reported from the earliest chunk that has one, so the
+// result matches a serial pass exactly. In incremental mode, sections the
+// last assembly already encoded the same way are taken from it instead.
 void SICXEAssembler::pass2() {
-    // First, validate all symbol references
-    validateSymbolReferences();
+    modificationRecords.assign(controlSections.size(), vector<ModificationRecord>());
+    textRecords.assign(controlSections.size(), vector<TextRecord>());
+    objectBytes.assign(controlSections.size() + 1, vector<uint8_t>());
+    
+    vector<size_t> bounds = sectionBoundaries();
+    size_t groups = bounds.size() - 1;
+    vector<char> encode(groups, 1);
+    resolveSymbols();
+    if (incremental) reuseSections(bounds, encode);
+    buildSectionScopes(bounds, encode);
+    
+    ThreadPool& pool = ThreadPool::shared();
+    if (sourceLines.size() < PARALLEL_PASS2_MIN || pool.size() < 2) {
+        for (size_t group = 0; group < groups; ++group) {
+            if (!encode[group]) continue;
+            encodeLines(bounds[group], bounds[group + 1], objectBytes[group]);
+            finishSection(group, bounds[group], bounds[group + 1]);
+        }
+        checkMemoryLimit();
+        if (incremental) recordSections(bounds, encode);
+        return;
+    }
+    
+    vector<EncodeChunk> chunks;
+    vector<size_t> firstChunk(groups + 1);
+    for (size_t group = 0; group < groups; ++group) {
+        firstChunk[group] = chunks.size();
+        if (!encode[group]) continue;
+        for (size_t begin = bounds[group]; begin < bounds[group + 1]; begin += PASS2_CHUNK_LINES) {
+            chunks.emplace_back(group, begin, min(begin + PASS2_CHUNK_LINES, bounds[group + 1]));
+        }
+    }
+    firstChunk[groups] = chunks.size();
     
-    for (auto& line : sourceLines) {
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        EncodeChunk& chunk = chunks[i];
+        try {
+            encodeLines(chunk.begin, chunk.end, chunk.code);
+        } catch (...) {
+            chunk.error = current_exception();
+        }
+    });
+    for (const EncodeChunk& chunk : chunks) {
+        if (chunk.error) rethrow_exception(chunk.error);
+    }
+    
+    pool.parallelFor(groups, [&](size_t group) {
+        if (!encode[group]) return;
+        vector<uint8_t>& code = objectBytes[group];
+        for (size_t i = firstChunk[group]; i < firstChunk[group + 1]; ++i) {
+            EncodeChunk& chunk = chunks[i];
+            if (code.empty()) {
+                code = move(chunk.code);
+                continue;
+            }
+            size_t offset = code.size();
+            code.insert(code.end(), chunk.code.begin(), chunk.code.end());
+            forEachLine(chunk.begin, chunk.end, [offset](AssemblyLine& line) {
+                if (line.codeLength > 0) line.codeOffset += offset;
+            });
+        }
+        finishSection(group, bounds[group], bounds[group + 1]);
+    });
+    checkMemoryLimit();
+    if (incremental) recordSections(bounds, encode);
+}
+
+// Source line ranges of the sections: group g (section g - 1) is
+// [bounds[g], bounds[g + 1]). Sections follow each other in the source, and
+// comment lines, which pass 2 skips, go with the section before them.
+vector<size_t> SICXEAssembler::sectionBoundaries() {
+    vector<size_t> bounds(controlSections.size() + 2, sourceLines.size());
+    bounds[0] = 0;
+    size_t group = 0;
+    for (size_t i = 0; i < sourceLines.size(); ++i) {
+        const AssemblyLine& line = sourceLines[i];
         if (line.isComment) continue;
+        for (; group < size_t(line.section + 1); ++group) {
+            bounds[group + 1] = i;
+        }
+    }
+    return bounds;
+}
+
+// Validation and generation share one traversal over the lines [begin, end);
+// a line is only generated once its operand has been validated. Literal
+// pool entries are visited where they are listed, so the bytes end up in
+// the order the section's T records are written.
+void SICXEAssembler::encodeLines(size_t begin, size_t end, vector<uint8_t>& code) {
+    forEachLine(begin, end, [&](AssemblyLine& line) {
+        if (line.isComment) return;
         
+        validateOperand(line);
         if (!line.opcode.empty() || (line.label == "*" && !line.operand.empty() && line.operand[0] == '=')) {
-            line.objectCode = generateObjectCode(line);
+            generateObjectCode(line, code);
         }
+    });
+}
+
+// T and M records of a section whose object code is in place
+void SICXEAssembler::finishSection(size_t group, size_t begin, size_t end) {
+    if (group > 0) {
+        generateTextRecords(group - 1, begin, end);
+        generateModificationRecords(begin, end);
+    }
+}
+
+// Object code and sections must end by MEMORY_SIZE, or the object file
+// would hold addresses no loader (nor our own readers) accepts
+void SICXEAssembler::checkMemoryLimit() {
+    const AssemblyLine* past = nullptr;
+    forEachLine([&past](const AssemblyLine& line) {
+        if (!past && line.codeLength > 0 && line.address + line.codeLength > MEMORY_SIZE) past = &line;
+    });
+    if (past) {
+        ostringstream error;
+        error << "Error on line " << past->lineNumber << ": Object code at " << hex << uppercase
+              << past->address << " runs past the end of SIC/XE memory (100000)" << endl;
+        throw AssemblyError(error.str());
+    }
+    for (const ControlSection& section : controlSections) {
+        if (int64_t(section.startAddress) + section.length > MEMORY_SIZE) {
+            ostringstream error;
+            error << "Error: Control section '" << section.name << "' ends at " << hex << uppercase
+                  << int64_t(section.startAddress) + section.length
+                  << ", past the end of SIC/XE memory (100000)" << endl;
+            throw AssemblyError(error.str());
+        }
+    }
+}
+
+// Point every interned operand name at its symbol table entry, and build
+// the per-section label scopes of the groups about to be encoded. Neither
+// changes after pass 1, so pass 2 lookups are a vector index or a single
+// hash probe.
+void SICXEAssembler::buildSectionScopes(const vector<size_t>& bounds, const vector<char>& encode) {
+    // Only labels that some operand refers to are interned; the first line
+    // carrying a label wins within its section
+    sectionScopes.assign(controlSections.size() + 1, unordered_map<int, int>());
+    for (size_t group = 0; group + 1 < bounds.size(); ++group) {
+        if (!encode[group]) continue;
+        forEachLine(bounds[group], bounds[group + 1], [this](const AssemblyLine& line) {
+            if (line.isComment) return;
+            auto id = symbolIds.find(line.label);
+            if (id != symbolIds.end()) {
+                sectionScopes[line.section + 1].emplace(id->second, line.address);
+            }
+        });
     }
-    
-    generateTextRecords();
-    generateModificationRecords();
 }
 
-string SICXEAssembler::generateObjectCode(const AssemblyLine& line) {
-    string opcode = line.opcode;
-    string operand = line.operand;
+void SICXEAssembler::resolveSymbols() {
+    resolvedSymbols.assign(symbolNames.size(), nullptr);
+    for (size_t id = 0; id < symbolNames.size(); ++id) {
+        auto entry = symbolTable.find(symbolNames[id]);
+        if (entry != symbolTable.end()) {
+            resolvedSymbols[id] = &entry->second;
+        }
+    }
+}
+
+const Symbol* SICXEAssembler::lookupSymbol(const Operand& operand) {
+    return operand.symbol < 0 ? nullptr : resolvedSymbols[operand.symbol];
+}
+
+// Append the line's object code to the buffer and record the span
+void SICXEAssembler::generateObjectCode(AssemblyLine& line, vector<uint8_t>& code) {
+    line.codeOffset = code.size();
+    encodeObjectCode(line, code);
+    line.codeLength = code.size() - line.codeOffset;
+}
+
+void SICXEAssembler::encodeObjectCode(const AssemblyLine& line, vector<uint8_t>& code) {
+    Opcode opcode = line.op;
+    string_view operand = line.operand;
     
     // Handle directives
-    if (opcode == "WORD") {
+    if (opcode == Opcode::WORD) {
+        int value = 0;
         if (!operand.empty()) {
-            try {
-                int value = stoi(operand);
-                return intToHex(value, 6);
-            } catch (...) {
+            if (line.decodedOperand.isConstant) {
+                value = line.decodedOperand.value;
+            } else if (const Symbol* symbol = lookupSymbol(line.decodedOperand)) {
                 // Handle symbol reference
-                if (symbolTable.find(operand) != symbolTable.end()) {
-                    return intToHex(symbolTable.at(operand).address, 6);
-                }
+                value = symbol->address;
             }
         }
-        return "000000";
+        appendBytes(code, value, 3);  // 24-bit two's complement
+        return;
     }
-    else if (opcode == "BYTE") {
+    else if (opcode == Opcode::BYTE) {
         if (!operand.empty()) {
             if (operand[0] == 'C') {
                 // Character constant
-                string chars = operand.substr(2, operand.length() - 3);
-                string result = "";
-                for (char c : chars) {
-                    result += intToHex((int)c, 2);
-                }
-                return result;
+                string_view chars = operand.substr(2, operand.length() - 3);
+                code.insert(code.end(), chars.begin(), chars.end());
             } else if (operand[0] == 'X') {
                 // Hexadecimal constant
-                return operand.substr(2, operand.length() - 3);
+                encodeHexDigits(line, operand.substr(2, operand.length() - 3), code);
             }
         }
-        return "";
+        return;
     }
-    else if (opcode == "BASE") {
-        // Handle BASE directive in Pass 2 for forward references
-        if (!operand.empty()) {
-            if (symbolTable.find(operand) != symbolTable.end()) {
-                baseRegister = symbolTable[operand].address;
-                baseSet = true;
-            }
-        }
-        return "";
+    else if (opcode == Opcode::BASE) {
+        // Resolved after pass 1 (see resolveBaseStates)
+        return;
     }
-    else if (opcode == "LTORG") {
+    else if (opcode == Opcode::LTORG) {
         // LTORG doesn't generate object code itself
         // The literals were already processed in Pass 1
-        return "";
+        return;
     }
     
     // Handle literal definitions (when processing lines with * label)
     if (!operand.empty() && operand[0] == '=' && !line.label.empty() && line.label == "*") {
-        return generateLiteralObjectCode(operand);
+        generateLiteralObjectCode(line, code);
+        return;
     }
     
-    // Handle extended format
-    bool isExtended = false;
-    if (opcode[0] == '+') {
-        isExtended = true;
-        opcode = opcode.substr(1);
-    }
-    
-    if (instructionTable.find(opcode) == instructionTable.end()) {
-        return "";
+    if (!line.instruction) {
+        return;
     }
     
-    int format = instructionTable[opcode].format;
-    if (isExtended && format == 3) {
+    // Handle extended format
+    int format = line.instruction->format;
+    if (line.extended && format == 3) {
         format = 4;
     }
     
     switch (format) {
         case 1:
-            return generateFormat1ObjectCode(opcode);
+            generateFormat1ObjectCode(*line.instruction, code);
+            break;
         case 2:
-            return generateFormat2ObjectCode(opcode, operand);
+            generateFormat2ObjectCode(*line.instruction, line.decodedOperand, code);
+            break;
         case 3:
-            return generateFormat3ObjectCode(opcode, operand, line.address);
+            generateFormat3ObjectCode(line, code);
+            break;
         case 4:
-            return generateFormat4ObjectCode(opcode, operand, line.address);
+            generateFormat4ObjectCode(line, code);
+            break;
         default:
-            return "";
+            break;
     }
 }
 
-string SICXEAssembler::generateFormat1ObjectCode(const string& opcode) {
-    return instructionTable[opcode].machineCode;
-}
-
-string SICXEAssembler::generateFormat2ObjectCode(const string& opcode, const string& operand) {
-    string result = instructionTable[opcode].machineCode;
-    
-    // Register mapping
-    map<string, string> registers = {
-        {"A", "0"}, {"X", "1"}, {"L", "2"}, {"B", "3"}, 
-        {"S", "4"}, {"T", "5"}, {"F", "6"}, {"PC", "8"}, {"SW", "9"}
-    };
-    
-    if (!operand.empty()) {
-        vector<string> regs = split(operand, ',');
-        if (regs.size() >= 1 && registers.find(regs[0]) != registers.end()) {
-            result += registers[regs[0]];
-        } else {
-            result += "0";
+// X'...' digits, two per byte; an odd count gets a leading zero nibble
+void SICXEAssembler::encodeHexDigits(const AssemblyLine& line, string_view digits, vector<uint8_t>& code) {
+    int value = 0;
+    for (size_t i = 0; i < digits.length(); ++i) {
+        int digit = hexDigitValue(digits[i]);
+        if (digit < 0) {
+            ostringstream error;
+            error << "Error on line " << line.lineNumber << ": Invalid hexadecimal constant '" 
+                  << line.operand << "'" << endl;
+            throw AssemblyError(error.str());
         }
-        
-        if (regs.size() >= 2 && registers.find(regs[1]) != registers.end()) {
-            result += registers[regs[1]];
-        } else {
-            result += "0";
+        value = (value << 4) | digit;
+        if ((digits.length() - i) % 2 == 1) {
+            code.push_back(uint8_t(value));
+            value = 0;
         }
-    } else {
-        result += "00";
     }
+}
+
+void SICXEAssembler::generateFormat1ObjectCode(const Instruction& instruction, vector<uint8_t>& code) {
+    code.push_back(instruction.machineCode);
+}
+
+void SICXEAssembler::generateFormat2ObjectCode(const Instruction& instruction, const Operand& operand, vector<uint8_t>& code) {
+    code.push_back(instruction.machineCode);
     
-    return result;
+    // Missing or invalid registers encode as 0
+    int r1 = operand.registers[0] < 0 ? 0 : operand.registers[0];
+    int r2 = operand.registers[1] < 0 ? 0 : operand.registers[1];
+    code.push_back(uint8_t((r1 << 4) | r2));
 }
 
-string SICXEAssembler::generateFormat3ObjectCode(const string& opcode, const string& operand, int address) {
-    int opcodeValue = hexToDecimal(instructionTable[opcode].machineCode);
+void SICXEAssembler::generateFormat3ObjectCode(const AssemblyLine& line, vector<uint8_t>& code) {
+    const Operand& operand = line.decodedOperand;
+    const BaseState& base = baseStates[line.baseState];
+    int address = line.address;
+    int opcodeValue = line.instruction->machineCode;
     int nixbpe = 0;
     int displacement = 0;
     
     // Set n and i bits based on addressing mode
-    bool immediate = isImmediate(operand);
-    bool indirect = isIndirect(operand);
-    bool indexed = isIndexed(operand);
+    bool immediate = operand.immediate;
+    bool indirect = operand.indirect;
+    bool indexed = operand.indexed;
     
     // n and i bit settings (bits 1 and 0 of nixbpe)
     if (immediate) {
@@ -161,39 +348,25 @@ string SICXEAssembler::generateFormat3ObjectCode(const string& opcode, const str
     }
     
     // Handle instructions with no operand
-    if (operand.empty()) {
+    if (line.operand.empty()) {
         displacement = 0;
         // No addressing mode flags needed for instructions without operands
     } else {
-        // Calculate displacement and set b/p bits
-        string baseOperand = getBaseOperand(operand);
-        int targetAddress = calculateTargetAddress(baseOperand, address);
-        
         // Handle immediate addressing with constants
-        if (immediate) {
-            try {
-                displacement = stoi(baseOperand); // baseOperand already has # removed
-                // For immediate constants, don't set b or p bits - use direct addressing
-            } catch (...) {
-                // Symbol reference - calculate displacement normally
-                displacement = targetAddress - (address + 3);
-                if (displacement >= -2048 && displacement <= 2047) {
-                    nixbpe |= 0x02; // p = 1 (PC-relative)
-                } else if (baseSet) {
-                    displacement = targetAddress - baseRegister;
-                    if (displacement >= 0 && displacement <= 4095) {
-                        nixbpe |= 0x04; // b = 1 (base-relative)
-                    }
-                }
-            }
+        if (immediate && operand.isConstant) {
+            displacement = operand.value;
+            // For immediate constants, don't set b or p bits - use direct addressing
         } else {
+            // Calculate displacement and set b/p bits
+            int targetAddress = calculateTargetAddress(operand, line.section);
+            
             // Try PC-relative addressing first
             displacement = targetAddress - (address + 3);
             if (displacement >= -2048 && displacement <= 2047) {
                 nixbpe |= 0x02; // p = 1 (PC-relative)
-            } else if (baseSet) {
+            } else if (base.set) {
                 // Try base-relative addressing
-                displacement = targetAddress - baseRegister;
+                displacement = targetAddress - base.address;
                 if (displacement >= 0 && displacement <= 4095) {
                     nixbpe |= 0x04; // b = 1 (base-relative)
                 }
@@ -211,18 +384,22 @@ string SICXEAssembler::generateFormat3ObjectCode(const string& opcode, const str
     int secondByte = ((nixbpe & 0x0F) << 4) | ((displacement >> 8) & 0x0F);
     int thirdByte = displacement & 0xFF;
     
-    return intToHex(firstByte, 2) + intToHex(secondByte, 2) + intToHex(thirdByte, 2);
+    code.push_back(uint8_t(firstByte));
+    code.push_back(uint8_t(secondByte));
+    code.push_back(uint8_t(thirdByte));
 }
 
-string SICXEAssembler::generateFormat4ObjectCode(const string& opcode, const string& operand, int address) {
-    int opcodeValue = hexToDecimal(instructionTable[opcode].machineCode);
+void SICXEAssembler::generateFormat4ObjectCode(const AssemblyLine& line, vector<uint8_t>& code) {
+    const Instruction& instruction = *line.instruction;
+    const Operand& operand = line.decodedOperand;
+    int opcodeValue = instruction.machineCode;
     int nixbpe = 0;
     int targetAddress = 0;
     
     // Set n, i, and e bits
-    bool immediate = isImmediate(operand);
-    bool indirect = isIndirect(operand);
-    bool indexed = isIndexed(operand);
+    bool immediate = operand.immediate;
+    bool indirect = operand.indirect;
+    bool indexed = operand.indexed;
     
     // e bit (bit 0) - extended format
     nixbpe |= 0x01; // e = 1 (extended format)
@@ -241,71 +418,14 @@ string SICXEAssembler::generateFormat4ObjectCode(const string& opcode, const str
         nixbpe |= 0x08; // x = 1
     }
     
-    // Calculate target address
-    string baseOperand = getBaseOperand(operand);
-    bool isExternal = false;
-    
-    // Find current control section by matching the exact instruction
-    string currentCS = "";
-    for (const auto& line : sourceLines) {
-        if (line.address == address && !line.opcode.empty()) {
-            // For Format 4 instructions, check if this is the right instruction
-            string lineOpcode = line.opcode;
-            if (lineOpcode[0] == '+') {
-                lineOpcode = lineOpcode.substr(1);
-            }
-            if (lineOpcode == opcode) {
-                currentCS = line.controlSection;
-                break;
-            }
-        }
-    }
-    
-    
-    // Check if this is an external reference in current control section EXTREF list
-    for (const auto& cs : controlSections) {
-        if (cs.name == currentCS) {
-            for (const auto& extRef : cs.extRef) {
-                if (extRef == baseOperand) {
-                    isExternal = true;
-                    targetAddress = 0; // External references use 0 in Format 4
-                    modificationRecords.push_back(ModificationRecord(address + 1, 5, baseOperand));
-                    break;
-                }
-            }
-            break;
-        }
-    }
-    
-    // Also check if symbol is explicitly marked as external in symbol table
-    if (!isExternal && symbolTable.find(baseOperand) != symbolTable.end() && 
-        symbolTable[baseOperand].isExternal) {
-        isExternal = true;
-        targetAddress = 0; // External references use 0 in Format 4
-        modificationRecords.push_back(ModificationRecord(address + 1, 5, baseOperand));
-    }
-    
-    // If not external, calculate the actual target address
-    if (!isExternal) {
-        targetAddress = calculateTargetAddress(baseOperand, address);
-        
+    // External references use 0 and are fixed up by the loader; the M
+    // records are made with the section's others (generateModificationRecords)
+    if (!isExternalOperand(line)) {
         // Handle immediate addressing with constants
-        if (immediate) {
-            try {
-                targetAddress = stoi(baseOperand); // baseOperand already has # removed
-            } catch (...) {
-                // Symbol reference - Format 4 needs modification record even for internal symbols
-                if (symbolTable.find(baseOperand) != symbolTable.end()) {
-                    // For internal symbols, use control section name for relocation
-                    modificationRecords.push_back(ModificationRecord(address + 1, 5, currentCS));
-                }
-            }
+        if (immediate && operand.isConstant) {
+            targetAddress = operand.value;
         } else {
-            // Non-immediate symbol reference - Format 4 needs modification record for internal symbols
-            if (symbolTable.find(baseOperand) != symbolTable.end()) {
-                // For internal symbols, use control section name for relocation
-                modificationRecords.push_back(ModificationRecord(address + 1, 5, currentCS));
-            }
+            targetAddress = calculateTargetAddress(operand, line.section);
         }
     }
     
@@ -313,48 +433,54 @@ string SICXEAssembler::generateFormat4ObjectCode(const string& opcode, const str
     // First 12 bits: 6-bit opcode + 6-bit nixbpe
     // Last 20 bits: address
     
-    int firstPart = ((opcodeValue & 0xFC) << 4) | (nixbpe & 0x3F);  // 12 bits
-    int addressPart = targetAddress & 0xFFFFF;  // 20 bits
+    uint32_t firstPart = ((opcodeValue & 0xFC) << 4) | (nixbpe & 0x3F);  // 12 bits
+    uint32_t addressPart = targetAddress & 0xFFFFF;  // 20 bits
     
     // Combine into 32-bit value
-    int fullInstruction = (firstPart << 20) | addressPart;
-    
-    return intToHex(fullInstruction, 8);
+    appendBytes(code, (firstPart << 20) | addressPart, 4);
 }
 
-string SICXEAssembler::generateLiteralObjectCode(const string& literal) {
+void SICXEAssembler::generateLiteralObjectCode(const AssemblyLine& line, vector<uint8_t>& code) {
+    string_view literal = line.operand;
     if (literal.substr(0, 2) == "=C") {
         // Character literal =C'EOF'
-        string chars = literal.substr(3, literal.length() - 4); // Remove =C' and '
-        string result = "";
-        for (char c : chars) {
-            result += intToHex((int)c, 2);
-        }
-        return result;
+        string_view chars = literal.substr(3, literal.length() - 4); // Remove =C' and '
+        code.insert(code.end(), chars.begin(), chars.end());
     } else if (literal.substr(0, 2) == "=X") {
         // Hexadecimal literal =X'05'
-        return literal.substr(3, literal.length() - 4); // Remove =X' and '
+        encodeHexDigits(line, literal.substr(3, literal.length() - 4), code); // Remove =X' and '
     } else {
         // Default case - treat as 3-byte constant
-        return "000000";
+        appendBytes(code, 0, 3);
     }
 }
 
+// A format 4 operand the loader supplies: in the section's EXTREF list or
+// marked external in the symbol table
+bool SICXEAssembler::isExternalOperand(const AssemblyLine& line) {
+    const Operand& operand = line.decodedOperand;
+    if (line.section >= 0 && controlSections[line.section].refersTo(operand.name)) {
+        return true;
+    }
+    const Symbol* symbol = lookupSymbol(operand);
+    return symbol && symbol->isExternal;
+}
+
 // Addressing mode helper functions
-bool SICXEAssembler::isImmediate(const string& operand) {
+bool SICXEAssembler::isImmediate(string_view operand) {
     return !operand.empty() && operand[0] == '#';
 }
 
-bool SICXEAssembler::isIndirect(const string& operand) {
+bool SICXEAssembler::isIndirect(string_view operand) {
     return !operand.empty() && operand[0] == '@';
 }
 
-bool SICXEAssembler::isIndexed(const string& operand) {
-    return operand.find(",X") != string::npos;
+bool SICXEAssembler::isIndexed(string_view operand) {
+    return operand.find(",X") != string_view::npos;
 }
 
-string SICXEAssembler::getBaseOperand(const string& operand) {
-    string result = operand;
+string_view SICXEAssembler::getBaseOperand(string_view operand) {
+    string_view result = operand;
     
     // Remove addressing mode prefixes
     if (result[0] == '#' || result[0] == '@') {
@@ -363,163 +489,115 @@ string SICXEAssembler::getBaseOperand(const string& operand) {
     
     // Remove indexing
     size_t commaPos = result.find(",X");
-    if (commaPos != string::npos) {
+    if (commaPos != string_view::npos) {
         result = result.substr(0, commaPos);
     }
     
     return result;
 }
 
-int SICXEAssembler::calculateTargetAddress(const string& operand, int currentAddress) {
-    // Find the current control section for the instruction
-    string currentCS = "";
-    ControlSection* currentCSObj = nullptr;
-    for (const auto& line : sourceLines) {
-        if (line.address == currentAddress) {
-            currentCS = line.controlSection;
-            break;
-        }
-    }
-    
-    // Find the current control section object
-    for (auto& cs : controlSections) {
-        if (cs.name == currentCS) {
-            currentCSObj = &cs;
-            break;
-        }
-    }
-    
+// Resolve an operand as seen from the given section (index into
+// controlSections, -1 outside any section)
+int SICXEAssembler::calculateTargetAddress(const Operand& target, int section) {
     // Check if the operand is in the current control section's EXTREF list
-    if (currentCSObj != nullptr) {
-        for (const string& extRef : currentCSObj->extRef) {
-            if (extRef == operand) {
-                // This is an external reference, return 0
-                return 0;
-            }
-        }
+    if (section >= 0 && controlSections[section].refersTo(target.name)) {
+        // This is an external reference, return 0
+        return 0;
     }
     
-    // First, try to find symbol in the current control section by searching sourceLines
-    for (const auto& line : sourceLines) {
-        if (line.label == operand && line.controlSection == currentCS && !line.isComment) {
-            return line.address;
-        }
+    // First, try a label defined in the current control section
+    const unordered_map<int, int>& scope = sectionScopes[section + 1];
+    auto local = scope.find(target.symbol);
+    if (local != scope.end()) {
+        return local->second;
     }
     
-    // If not found in sourceLines, try symbol table for current control section
-    for (const auto& symbol : symbolTable) {
-        if (symbol.first == operand && symbol.second.controlSection == currentCS && 
-            !symbol.second.isExternal && symbol.second.isDefined) {
-            return symbol.second.address;
-        }
-    }
-    
-    // If not found in current control section, use the general lookup
-    if (symbolTable.find(operand) != symbolTable.end()) {
-        const Symbol& symbol = symbolTable[operand];
+    // If not found in this section, use the symbol table entry
+    const Symbol* symbol = lookupSymbol(target);
+    if (symbol) {
         // If symbol is external, return 0 (will be resolved by linker)
-        if (symbol.isExternal) {
+        if (symbol->isExternal) {
             return 0;
         }
-        return symbol.address;
+        return symbol->address;
     }
     
-    // Try to parse as number
-    try {
-        return stoi(operand);
-    } catch (...) {
-        return 0;
-    }
+    // Otherwise the operand is a number (or unknown)
+    return target.isConstant ? target.value : 0;
 }
 
-void SICXEAssembler::validateSymbolReferences() {
-    for (const auto& line : sourceLines) {
-        if (line.isComment || line.operand.empty()) continue;
-        
-        // Skip directives that don't need symbol validation
-        if (line.opcode == "START" || line.opcode == "END" || line.opcode == "CSECT" ||
-            line.opcode == "EXTDEF" || line.opcode == "EXTREF" || line.opcode == "BASE" ||
-            line.opcode == "NOBASE" || line.opcode == "RESW" || line.opcode == "RESB" ||
-            line.opcode == "LTORG" || line.opcode == "EQU" || line.opcode == "BYTE") {
-            continue;
-        }
-        
-        string operand = line.operand;
-        
-        // Skip literals, immediate values, and indexed addressing
-        if (operand[0] == '=' || operand[0] == '#') continue;
+void SICXEAssembler::validateOperand(const AssemblyLine& line) {
+    if (line.operand.empty()) return;
+    
+    // Skip directives that don't need symbol validation
+    if (line.op == Opcode::START || line.op == Opcode::END || line.op == Opcode::CSECT ||
+        line.op == Opcode::EXTDEF || line.op == Opcode::EXTREF || line.op == Opcode::BASE ||
+        line.op == Opcode::NOBASE || line.op == Opcode::RESW || line.op == Opcode::RESB ||
+        line.op == Opcode::LTORG || line.op == Opcode::EQU || line.op == Opcode::BYTE) {
+        return;
+    }
+    
+    const Operand& operand = line.decodedOperand;
+    
+    // Skip literals, immediate values, and indexed addressing
+    if (operand.literal || operand.immediate) return;
+    
+    // Handle WORD directive with expressions
+    if (line.op == Opcode::WORD) {
+        // A number needs no validation
+        if (operand.isConstant) return;
         
-        // Handle WORD directive with expressions
-        if (line.opcode == "WORD") {
-            // Check if it's a number
-            try {
-                stoi(operand);
-                continue; // It's a number, skip validation
-            } catch (...) {
-                // It's an expression, validate symbols in it
-                if (operand.find('-') != string::npos) {
-                    vector<string> parts = split(operand, '-');
-                    for (const string& part : parts) {
-                        string symbol = trim(part);
-                        if (symbolTable.find(symbol) == symbolTable.end() && 
-                            !isExternalReference(symbol, line.controlSection)) {
-                            cerr << "Error on line " << line.lineNumber << ": Undefined symbol '" 
-                                 << symbol << "' in WORD expression" << endl;
-                            exit(1);
-                        }
-                    }
-                } else {
-                    // Single symbol reference
-                    if (symbolTable.find(operand) == symbolTable.end() && 
-                        !isExternalReference(operand, line.controlSection)) {
-                        cerr << "Error on line " << line.lineNumber << ": Undefined symbol '" 
-                             << operand << "' in WORD directive" << endl;
-                        exit(1);
-                    }
+        // It's an expression, validate symbols in it
+        if (line.operand.find('-') != string_view::npos) {
+            vector<string_view> parts = split(line.operand, '-');
+            for (string_view part : parts) {
+                string_view symbol = trim(part);
+                if (symbolTable.find(symbol) == symbolTable.end() && 
+                    !isExternalReference(symbol, line.section)) {
+                    ostringstream error;
+                    error << "Error on line " << line.lineNumber << ": Undefined symbol '" 
+                          << symbol << "' in WORD expression" << endl;
+                    throw AssemblyError(error.str());
                 }
             }
-            continue;
+        } else {
+            // Single symbol reference
+            if (!lookupSymbol(operand) && !isExternalReference(operand.name, line.section)) {
+                ostringstream error;
+                error << "Error on line " << line.lineNumber << ": Undefined symbol '" 
+                      << operand.name << "' in WORD directive" << endl;
+                throw AssemblyError(error.str());
+            }
         }
-        
-        // Handle Format 2 instructions with register operands
-        if (instructionTable.find(line.opcode) != instructionTable.end() && 
-            instructionTable[line.opcode].format == 2) {
-            // Format 2 instructions use registers - validate each register separately
-            vector<string> registers = split(operand, ',');
-            for (const string& reg : registers) {
+        return;
+    }
+    
+    // Handle Format 2 instructions with register operands
+    if (line.instruction && !line.extended && line.instruction->format == 2) {
+        if (!operand.validRegisters) {
+            // Report the first token that is not a register
+            for (string_view reg : split(line.operand, ',')) {
                 if (!isRegisterName(reg)) {
-                    cerr << "Error on line " << line.lineNumber << ": Invalid register '" 
-                         << reg << "' in Format 2 instruction" << endl;
-                    exit(1);
+                    ostringstream error;
+                    error << "Error on line " << line.lineNumber << ": Invalid register '" 
+                          << reg << "' in Format 2 instruction" << endl;
+                    throw AssemblyError(error.str());
                 }
             }
-            continue;
-        }
-        
-        // Extract base operand (remove addressing mode prefixes and indexing)
-        string baseOperand = getBaseOperand(operand);
-        
-        // Skip if it's a number
-        try {
-            stoi(baseOperand);
-            continue;
-        } catch (...) {
-            // Not a number, continue validation
-        }
-        
-        // Skip if it's a register name
-        if (isRegisterName(baseOperand)) {
-            continue;
-        }
-        
-        // Check if symbol exists in symbol table or is external reference
-        if (symbolTable.find(baseOperand) == symbolTable.end() && 
-            !isExternalReference(baseOperand, line.controlSection)) {
-            cerr << "Error on line " << line.lineNumber << ": Undefined symbol '" 
-                 << baseOperand << "' in operand field" << endl;
-            cerr << "Symbol '" << baseOperand << "' is not defined in control section '" 
-                 << line.controlSection << "' and not declared in EXTREF" << endl;
-            exit(1);
         }
+        return;
+    }
+    
+    // Numbers and register names need no symbol
+    if (operand.isConstant || operand.isRegister) return;
+    
+    // Check if symbol exists in symbol table or is external reference
+    if (!lookupSymbol(operand) && !isExternalReference(operand.name, line.section)) {
+        ostringstream error;
+        error << "Error on line " << line.lineNumber << ": Undefined symbol '" 
+              << operand.name << "' in operand field" << endl;
+        error << "Symbol '" << operand.name << "' is not defined in control section '" 
+              << line.controlSection << "' and not declared in EXTREF" << endl;
+        throw AssemblyError(error.str());
     }
 }
@@ -0,0 +1,337 @@
+#include "assembler.h"
+#include "thread_pool.h"
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Messages: a 4-byte tag, then 32-bit fields in host order (the socket
+// never leaves the machine). Strings are a 32-bit length and the bytes.
+//
+//   request  "SXRQ" version flags input listing object source
+//   reply    "SXRP" status diagnostics
+namespace {
+
+const char REQUEST_TAG[4] = { 'S', 'X', 'R', 'Q' };
+const char REPLY_TAG[4] = { 'S', 'X', 'R', 'P' };
+const uint32_t PROTOCOL_VERSION = 1;
+const uint32_t REQUEST_BINARY = 1;
+const uint32_t REQUEST_INLINE = 2;
+const uint32_t MAX_STRING = 1u << 30;
+
+void putWord(string& message, uint32_t value) {
+    message.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(string& message, const string& text) {
+    putWord(message, text.size());
+    message += text;
+}
+
+bool sendAll(int fd, const string& message) {
+    size_t sent = 0;
+    while (sent < message.size()) {
+        ssize_t n = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void* data, size_t size) {
+    char* out = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = recv(fd, out, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        out += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool receiveWord(int fd, uint32_t& value) {
+    return receiveAll(fd, &value, sizeof(value));
+}
+
+bool receiveString(int fd, string& text) {
+    uint32_t length;
+    if (!receiveWord(fd, length) || length > MAX_STRING) return false;
+    text.resize(length);
+    return receiveAll(fd, &text[0], length);
+}
+
+bool receiveTag(int fd, const char (&tag)[4]) {
+    char received[4];
+    return receiveAll(fd, received, sizeof(received)) && memcmp(received, tag, sizeof(tag)) == 0;
+}
+
+// Assemblers kept warm between requests, so their tables and output
+// buffers are already allocated when the next one arrives. Each remembers
+// the input it last assembled; a request for the same input gets that
+// assembler back, so its incremental cache applies.
+class AssemblerCache {
+private:
+    mutex lock;
+    vector<pair<string, unique_ptr<SICXEAssembler>>> idle;
+    BuildCache* buildCache;
+
+public:
+    explicit AssemblerCache(BuildCache* cache) : buildCache(cache) {}
+
+    unique_ptr<SICXEAssembler> acquire(const string& input) {
+        {
+            lock_guard<mutex> guard(lock);
+            if (!idle.empty()) {
+                size_t chosen = idle.size() - 1;
+                for (size_t i = 0; i < idle.size(); ++i) {
+                    if (idle[i].first == input) chosen = i;
+                }
+                unique_ptr<SICXEAssembler> assembler = move(idle[chosen].second);
+                idle.erase(idle.begin() + chosen);
+                return assembler;
+            }
+        }
+        unique_ptr<SICXEAssembler> assembler(new SICXEAssembler());
+        assembler->setBatchMode(true);
+        assembler->setIncremental(true);
+        assembler->setBuildCache(buildCache);
+        return assembler;
+    }
+
+    void release(const string& input, unique_ptr<SICXEAssembler> assembler) {
+        lock_guard<mutex> guard(lock);
+        idle.emplace_back(input, move(assembler));
+    }
+};
+
+// Open connections, so that stopping the server can end the idle ones
+class ConnectionSet {
+private:
+    mutex lock;
+    unordered_set<int> open;
+
+public:
+    void add(int fd) {
+        lock_guard<mutex> guard(lock);
+        open.insert(fd);
+    }
+
+    void remove(int fd) {
+        lock_guard<mutex> guard(lock);
+        open.erase(fd);
+        close(fd);
+    }
+
+    // Requests being served still get their reply
+    void stopReading() {
+        lock_guard<mutex> guard(lock);
+        for (int fd : open) {
+            shutdown(fd, SHUT_RD);
+        }
+    }
+};
+
+ServerReply handleRequest(const ServerRequest& request, SICXEAssembler& assembler) {
+    ServerReply reply;
+    try {
+        if (request.inlineSource) {
+            assembler.assembleSource(request.source, request.listingFile, request.objectFile, request.format);
+        } else {
+            assembler.assemble(request.input, request.listingFile, request.objectFile, request.format);
+        }
+    } catch (const AssemblyError& e) {
+        reply.status = 1;
+        reply.diagnostics = e.what();
+    } catch (const exception& e) {
+        reply.status = 1;
+        reply.diagnostics = string("Error: ") + e.what() + "\n";
+    }
+    assembler.reset();   // don't hold on to the source until the next request
+    return reply;
+}
+
+// Requests name files the server writes with its owner's rights, so only
+// its owner's processes are served
+void serveConnection(int fd, AssemblerCache& cache, ConnectionSet& connections) {
+    ServerRequest request;
+    while (sameUser(fd) && receiveRequest(fd, request)) {
+        unique_ptr<SICXEAssembler> assembler = cache.acquire(request.input);
+        ServerReply reply = handleRequest(request, *assembler);
+        cache.release(request.input, move(assembler));
+        if (!sendReply(fd, reply)) break;
+    }
+    connections.remove(fd);
+}
+
+volatile sig_atomic_t stopping = 0;
+int listener = -1;
+
+// shutdown() is async-signal-safe and makes the blocked accept() return
+void stopServer(int) {
+    stopping = 1;
+    shutdown(listener, SHUT_RDWR);
+}
+
+// Without a runtime directory the socket goes in a directory of its own
+// in /tmp, which runServer() creates readable only by its owner
+string privateSocketDirectory() {
+    return "/tmp/sicxe_assembler." + to_string(getuid());
+}
+
+// Creates the directory if needed; false unless it is ours and nobody
+// else can get into it
+bool usePrivateDirectory(const string& directory) {
+    struct stat info;
+    if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) return false;
+    if (lstat(directory.c_str(), &info) != 0) return false;
+    if (!S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077) != 0) {
+        errno = EPERM;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+string defaultSocketPath() {
+    const char* path = getenv("SICXE_SOCKET");
+    if (path && *path) return path;
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) return string(runtime) + "/sicxe_assembler.sock";
+    return privateSocketDirectory() + "/server.sock";
+}
+
+bool sameUser(int fd) {
+    ucred peer;
+    socklen_t size = sizeof(peer);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 && peer.uid == getuid();
+}
+
+bool ownSocket(const string& path) {
+    struct stat info;
+    return lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode) && info.st_uid == getuid();
+}
+
+bool sendRequest(int fd, const ServerRequest& request) {
+    string message(REQUEST_TAG, sizeof(REQUEST_TAG));
+    putWord(message, PROTOCOL_VERSION);
+    putWord(message, (request.format == ObjectFormat::BINARY ? REQUEST_BINARY : 0) |
+                     (request.inlineSource ? REQUEST_INLINE : 0));
+    putString(message, request.input);
+    putString(message, request.listingFile);
+    putString(message, request.objectFile);
+    putString(message, request.source);
+    return sendAll(fd, message);
+}
+
+bool receiveRequest(int fd, ServerRequest& request) {
+    uint32_t version, flags;
+    if (!receiveTag(fd, REQUEST_TAG) || !receiveWord(fd, version) || version != PROTOCOL_VERSION ||
+        !receiveWord(fd, flags)) {
+        return false;
+    }
+    request.format = (flags & REQUEST_BINARY) ? ObjectFormat::BINARY : ObjectFormat::TEXT;
+    request.inlineSource = (flags & REQUEST_INLINE) != 0;
+    return receiveString(fd, request.input) && receiveString(fd, request.listingFile) &&
+           receiveString(fd, request.objectFile) && receiveString(fd, request.source);
+}
+
+bool sendReply(int fd, const ServerReply& reply) {
+    string message(REPLY_TAG, sizeof(REPLY_TAG));
+    putWord(message, uint32_t(reply.status));
+    putString(message, reply.diagnostics);
+    return sendAll(fd, message);
+}
+
+bool receiveReply(int fd, ServerReply& reply) {
+    uint32_t status;
+    if (!receiveTag(fd, REPLY_TAG) || !receiveWord(fd, status)) return false;
+    reply.status = int(status);
+    return receiveString(fd, reply.diagnostics);
+}
+
+int runServer(const string& socketPath, size_t jobs, BuildCache* buildCache) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        cerr << "Error: Socket path too long: " << socketPath << endl;
+        return 1;
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    string directory = privateSocketDirectory();
+    if (socketPath.compare(0, directory.size() + 1, directory + "/") == 0 && !usePrivateDirectory(directory)) {
+        cerr << "Error: Cannot use socket directory " << directory << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        cerr << "Error: Cannot create socket: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // The socket file is created without access for anyone else; the
+    // peer check in serveConnection() stands even where that is ignored
+    mode_t mask = umask(077);
+    // A socket file nobody answers on is left over from a previous server
+    int bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    if (bound != 0 && errno == EADDRINUSE) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool running = connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        close(probe);
+        struct stat info;
+        if (running) {
+            cerr << "Error: A server is already listening on " << socketPath << endl;
+            close(listener);
+            return 1;
+        }
+        if (lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            unlink(socketPath.c_str());
+            bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        }
+    }
+    umask(mask);
+    if (bound != 0 || listen(listener, SOMAXCONN) != 0) {
+        cerr << "Error: Cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+        close(listener);
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    cout << "Listening on " << socketPath << " (" << jobs << " jobs)" << endl;
+
+    // Each connection is served by a pool task; the pool's size bounds how
+    // many connections are served at once
+    AssemblerCache cache(buildCache);
+    ConnectionSet connections;
+    ThreadPool& pool = ThreadPool::shared();
+    while (!stopping) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (!stopping) cerr << "Error: accept failed: " << strerror(errno) << endl;
+            break;
+        }
+        connections.add(fd);
+        pool.submit([fd, &cache, &connections] { serveConnection(fd, cache, connections); });
+    }
+
+    connections.stopReading();
+    pool.wait();
+    close(listener);
+    unlink(socketPath.c_str());
+    cout << "Server stopped" << endl;
+    return 0;
+}
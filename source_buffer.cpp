@@ -0,0 +1,50 @@
+#include "assembler.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool SourceBuffer::open(const string& filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        // Private writable mapping: parseLine upper-cases labels and opcodes in
+        // place, and only the pages it actually touches get copied.
+        void* addr = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            mapped = static_cast<char*>(addr);
+            mappedSize = info.st_size;
+            madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+            ::close(fd);
+            return true;
+        }
+    }
+
+    // Fall back to reading the whole input (pipes, special files, empty files)
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        owned.insert(owned.end(), chunk, chunk + n);
+    }
+    ::close(fd);
+    return n == 0;
+}
+
+// Parsing upper-cases fields in place, so in-memory sources are copied too
+void SourceBuffer::assign(string_view text) {
+    close();
+    owned.assign(text.begin(), text.end());
+}
+
+void SourceBuffer::close() {
+    if (mapped) {
+        munmap(mapped, mappedSize);
+        mapped = nullptr;
+        mappedSize = 0;
+    }
+    owned.clear();
+}
@@ -0,0 +1,106 @@
+#!/bin/sh
+# Checks run by 'make test' from the top of the tree, on the built tools.
+# Each check prints 'ok' or 'FAILED' and a reason; the exit status is the
+# number of failures.
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failures=0
+
+pass() { echo "ok      $1"; }
+fail() { echo "FAILED  $1: $2"; failures=$((failures + 1)); }
+
+size() { wc -c < "$1" | tr -d ' '; }
+
+# Assembles $1 to $WORK/$2.obj (text) and $WORK/$2.sxo (binary)
+assemble_both() {
+    ./sicxe_assembler --pass1 "$1" "$WORK/$2.p1" > /dev/null &&
+        ./sicxe_assembler --pass2 --no-listing "$WORK/$2.p1" "$WORK/$2.obj" > /dev/null &&
+        ./sicxe_assembler --pass2 --binary --no-listing "$WORK/$2.p1" "$WORK/$2.sxo" > /dev/null
+}
+
+# A large multi-section program: many lines, external references and WORDs
+large_program() {
+    awk 'BEGIN {
+        for (s = 0; s < 20; ++s) {
+            printf "S%02d\t%s\n", s, s == 0 ? "START\t0" : "CSECT"
+            printf "\tEXTDEF\tE%02d\n", s
+            printf "\tEXTREF\tE%02d\n", (s + 1) % 20
+            printf "E%02d\tLDA\t#0\n", s
+            for (i = 0; i < 2000; ++i) {
+                if (i % 4 == 0) printf "\t+JSUB\tE%02d\n", (s + 1) % 20
+                else if (i % 4 == 1) printf "\tWORD\tE%02d\n", (s + 1) % 20
+                else if (i % 4 == 2) printf "L%d\tLDA\t#%d\n", i, i
+                else printf "\tJ\tL%d\n", i - 1
+            }
+            print "\tRSUB"
+        }
+        print "\tEND\tE00"
+    }'
+}
+
+# The binary object format is the compact one: smaller than the text form,
+# and converts back to it exactly
+check_binary_size() {
+    name=$1
+    if ! assemble_both "$2" "$name"; then
+        fail "binary size ($name)" "assembly failed"
+        return
+    fi
+    text=$(size "$WORK/$name.obj")
+    binary=$(size "$WORK/$name.sxo")
+    if [ "$binary" -lt "$text" ]; then
+        pass "binary size ($name): $binary bytes, text $text bytes"
+    else
+        fail "binary size ($name)" "$binary bytes, not smaller than the text's $text"
+    fi
+    if ./sicxe_objconv "$WORK/$name.sxo" "$WORK/$name.back" > /dev/null &&
+        cmp -s "$WORK/$name.obj" "$WORK/$name.back"; then
+        pass "binary round trip ($name)"
+    else
+        fail "binary round trip ($name)" "converting the binary back does not give the text form"
+    fi
+}
+
+# Programs past the 20-bit address space are reported when assembled, and
+# objects with such addresses are rejected as out of range, not corrupt
+check_memory_limit() {
+    printf 'P\tSTART\t0\nFIRST\tLDA\t#1\n\tRESB\t1048573\n\tLDA\t#2\n\tEND\tFIRST\n' > "$WORK/past.asm"
+    if ./sicxe_assembler --no-listing "$WORK/past.asm" "$WORK/past.obj" < /dev/null 2>&1 | grep -q 'past the end of SIC/XE memory'; then
+        pass "memory limit (assembler)"
+    else
+        fail "memory limit (assembler)" "a program past 100000 was not reported"
+    fi
+    printf 'H^P     ^000000^00000A\nT^FFFFF0^03^00000A\nE^000000\n' > "$WORK/past.obj"
+    if ./sicxe_loader -o /dev/null "$WORK/past.obj" 2>&1 | grep -q 'Address out of range'; then
+        pass "memory limit (reader)"
+    else
+        fail "memory limit (reader)" "a T record past 100000 was not reported as out of range"
+    fi
+}
+
+# A section assembled from a nonzero START and loaded elsewhere: its
+# internal M records move addresses by the load address minus START
+check_nonzero_start() {
+    printf 'P\tSTART\t1000\nFIRST\t+LDA\tDATA\n\tJ\tFIRST\nDATA\tWORD\t5\n\tEND\tFIRST\n' > "$WORK/start.asm"
+    if ! ./sicxe_assembler --no-listing "$WORK/start.asm" "$WORK/start.obj" < /dev/null > /dev/null ||
+        ! ./sicxe_loader -a 2000 -o "$WORK/start.img" "$WORK/start.obj" > /dev/null; then
+        fail "nonzero START load" "assembling or loading failed"
+        return
+    fi
+    # +LDA DATA, with DATA at 2007 once loaded
+    field=$(od -An -tx1 -N4 "$WORK/start.img" | tr -d ' ')
+    if [ "$field" = "03102007" ]; then
+        pass "nonzero START load"
+    else
+        fail "nonzero START load" "+LDA assembled to $field, expected 03102007"
+    fi
+}
+
+check_binary_size program program.asm
+large_program > "$WORK/large.asm"
+check_binary_size large "$WORK/large.asm"
+check_memory_limit
+check_nonzero_start
+
+exit $failures
@@ -0,0 +1,115 @@
+#include "thread_pool.h"
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threads) : running(0), stopping(false) {
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        function<void()> task;
+        {
+            unique_lock<std::mutex> lock(queueMutex);
+            taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+            task = move(tasks.front());
+            tasks.pop_front();
+            ++running;
+        }
+        task();
+        {
+            lock_guard<std::mutex> lock(queueMutex);
+            --running;
+            if (tasks.empty() && running == 0) allDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool::submit(function<void()> task) {
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        tasks.push_back(move(task));
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<std::mutex> lock(queueMutex);
+    allDone.wait(lock, [this] { return tasks.empty() && running == 0; });
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body) {
+    if (count == 0) return;
+    if (count == 1 || workers.empty()) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+
+    // Indices are claimed from a shared counter, so the caller makes progress
+    // even if every worker is busy (parallelFor may be nested inside a task).
+    // Helpers that start late find nothing left and never touch 'body'.
+    struct State {
+        atomic<size_t> next;
+        std::mutex mutex;
+        condition_variable finished;
+        size_t completed;
+        exception_ptr error;
+    };
+    auto state = make_shared<State>();
+    state->next = 0;
+    state->completed = 0;
+
+    const function<void(size_t)>* work = &body;
+    auto run = [state, count, work]() {
+        for (size_t i = state->next++; i < count; i = state->next++) {
+            try {
+                (*work)(i);
+            } catch (...) {
+                lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error) state->error = current_exception();
+            }
+            lock_guard<std::mutex> lock(state->mutex);
+            if (++state->completed == count) state->finished.notify_all();
+        }
+    };
+
+    size_t helpers = min(workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit(run);
+    }
+    run();
+
+    unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->completed == count; });
+    if (state->error) rethrow_exception(state->error);
+}
+
+static size_t sharedSize = 0;
+
+void ThreadPool::setSharedSize(size_t threads) {
+    sharedSize = threads;
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(sharedSize);
+    return pool;
+}
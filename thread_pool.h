@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads shared by the parallel stages of the
+// assembler. Tasks are plain closures; parallelFor() is the usual entry point.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable taskReady;
+    std::condition_variable allDone;
+    size_t running;
+    bool stopping;
+
+    void workerLoop();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+public:
+    // threads == 0 uses one thread per hardware core
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    size_t size() const { return workers.size(); }
+    void submit(std::function<void()> task);
+    void wait();
+
+    // Runs body(0) .. body(count - 1) on the pool and waits for all of them.
+    // The calling thread helps out; the first exception thrown is rethrown.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // Process-wide pool sized to the machine, or to setSharedSize() when
+    // that is called before the pool is first used
+    static ThreadPool& shared();
+    static void setSharedSize(size_t threads);
+};
+
+#endif // THREAD_POOL_H
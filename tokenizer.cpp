@@ -0,0 +1,249 @@
+#include "assembler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SICXE_X86 1
+#endif
+
+// Stage 1: classify source bytes into bitmasks, 64 bytes per mask word.
+// The scalar, SSE2 (16 bytes per compare) and AVX2 (32 bytes per compare)
+// classifiers produce identical masks; one is picked per scanner.
+
+namespace {
+
+inline void classifyScalarWord(const char* text, size_t length, uint64_t* newline, uint64_t* tab,
+                               uint64_t* space, uint64_t* mark) {
+    uint64_t newlineBits = 0, tabBits = 0, spaceBits = 0, markBits = 0;
+    for (size_t i = 0; i < length; ++i) {
+        uint64_t bit = uint64_t(1) << i;
+        switch (text[i]) {
+            case '\n': newlineBits |= bit; break;
+            case '\t': tabBits |= bit; break;
+            case ' ':  spaceBits |= bit; break;
+            case '\'':
+            case '.':  markBits |= bit; break;
+            default: break;
+        }
+    }
+    *newline = newlineBits;
+    *tab = tabBits;
+    *space = spaceBits;
+    *mark = markBits;
+}
+
+void classifyScalar(const char* text, size_t length, uint64_t* newline, uint64_t* tab,
+                    uint64_t* space, uint64_t* mark) {
+    for (size_t offset = 0, word = 0; offset < length; offset += 64, ++word) {
+        classifyScalarWord(text + offset, min<size_t>(64, length - offset),
+                           newline + word, tab + word, space + word, mark + word);
+    }
+}
+
+#ifdef SICXE_X86
+void classifySSE2(const char* text, size_t length, uint64_t* newline, uint64_t* tab,
+                  uint64_t* space, uint64_t* mark) {
+    const __m128i newlineChar = _mm_set1_epi8('\n');
+    const __m128i tabChar = _mm_set1_epi8('\t');
+    const __m128i spaceChar = _mm_set1_epi8(' ');
+    const __m128i quoteChar = _mm_set1_epi8('\'');
+    const __m128i dotChar = _mm_set1_epi8('.');
+
+    size_t offset = 0, word = 0;
+    for (; offset + 64 <= length; offset += 64, ++word) {
+        uint64_t newlineBits = 0, tabBits = 0, spaceBits = 0, markBits = 0;
+        for (int part = 0; part < 4; ++part) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + offset + part * 16));
+            int shift = part * 16;
+            newlineBits |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newlineChar)))) << shift;
+            tabBits |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, tabChar)))) << shift;
+            spaceBits |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, spaceChar)))) << shift;
+            __m128i marks = _mm_or_si128(_mm_cmpeq_epi8(bytes, quoteChar), _mm_cmpeq_epi8(bytes, dotChar));
+            markBits |= uint64_t(uint16_t(_mm_movemask_epi8(marks))) << shift;
+        }
+        newline[word] = newlineBits;
+        tab[word] = tabBits;
+        space[word] = spaceBits;
+        mark[word] = markBits;
+    }
+    if (offset < length) {
+        classifyScalarWord(text + offset, length - offset, newline + word, tab + word, space + word, mark + word);
+    }
+}
+
+__attribute__((target("avx2")))
+inline uint64_t movemask64(__m256i low, __m256i high) {
+    return uint64_t(uint32_t(_mm256_movemask_epi8(low))) |
+           (uint64_t(uint32_t(_mm256_movemask_epi8(high))) << 32);
+}
+
+__attribute__((target("avx2")))
+void classifyAVX2(const char* text, size_t length, uint64_t* newline, uint64_t* tab,
+                  uint64_t* space, uint64_t* mark) {
+    const __m256i newlineChar = _mm256_set1_epi8('\n');
+    const __m256i tabChar = _mm256_set1_epi8('\t');
+    const __m256i spaceChar = _mm256_set1_epi8(' ');
+    const __m256i quoteChar = _mm256_set1_epi8('\'');
+    const __m256i dotChar = _mm256_set1_epi8('.');
+
+    size_t offset = 0, word = 0;
+    for (; offset + 64 <= length; offset += 64, ++word) {
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + offset));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + offset + 32));
+        newline[word] = movemask64(_mm256_cmpeq_epi8(low, newlineChar), _mm256_cmpeq_epi8(high, newlineChar));
+        tab[word] = movemask64(_mm256_cmpeq_epi8(low, tabChar), _mm256_cmpeq_epi8(high, tabChar));
+        space[word] = movemask64(_mm256_cmpeq_epi8(low, spaceChar), _mm256_cmpeq_epi8(high, spaceChar));
+        mark[word] = movemask64(_mm256_or_si256(_mm256_cmpeq_epi8(low, quoteChar), _mm256_cmpeq_epi8(low, dotChar)),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(high, quoteChar), _mm256_cmpeq_epi8(high, dotChar)));
+    }
+    if (offset < length) {
+        classifyScalarWord(text + offset, length - offset, newline + word, tab + word, space + word, mark + word);
+    }
+}
+#endif
+
+FieldScanner::Classifier selectClassifier(FieldScanner::Mode mode) {
+#ifdef SICXE_X86
+    __builtin_cpu_init();
+    bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (mode == FieldScanner::AUTO) {
+        mode = hasAVX2 ? FieldScanner::AVX2 : FieldScanner::SSE2;
+    }
+    if (mode == FieldScanner::AVX2 && hasAVX2) return classifyAVX2;
+    if (mode != FieldScanner::SCALAR) return classifySSE2;
+#else
+    (void)mode;
+#endif
+    return classifyScalar;
+}
+
+// Position of the first bit in [from, to) that is set in 'mask' (or clear,
+// when 'invert' is true); 'to' if there is none.
+inline size_t nextBit(const uint64_t* mask, size_t from, size_t to, bool invert = false) {
+    while (from < to) {
+        size_t word = from >> 6;
+        uint64_t bits = invert ? ~mask[word] : mask[word];
+        bits &= ~uint64_t(0) << (from & 63);
+        if (bits) {
+            size_t pos = (word << 6) + __builtin_ctzll(bits);
+            return pos < to ? pos : to;
+        }
+        from = (word + 1) << 6;
+    }
+    return to;
+}
+
+inline string_view trimField(const char* begin, const char* end) {
+    while (begin < end && (*begin == ' ' || *begin == '\r')) ++begin;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\r')) --end;
+    return string_view(begin, end - begin);
+}
+
+} // namespace
+
+FieldScanner::FieldScanner(const char* text, size_t length, Mode mode)
+    : text(text), length(length), position(0), windowStart(0), windowLength(0),
+      classify(selectClassifier(mode)) {}
+
+const char* FieldScanner::modeName(Mode mode) {
+#ifdef SICXE_X86
+    Classifier classifier = selectClassifier(mode);
+    if (classifier == classifyAVX2) return "avx2";
+    if (classifier == classifySSE2) return "sse2";
+#else
+    (void)mode;
+#endif
+    return "scalar";
+}
+
+bool FieldScanner::next(LineFields& fields) {
+    if (position >= length) return false;
+
+    // The line must lie inside the classified window; a line that runs past
+    // the end of the window starts a new one.
+    size_t windowEnd = windowStart + windowLength;
+    size_t lineEnd = windowEnd;
+    if (position < windowEnd) {
+        lineEnd = windowStart + nextBit(newlineMask, position - windowStart, windowLength);
+    }
+    if (lineEnd == windowEnd && windowEnd < length) {
+        windowStart = position;
+        windowLength = min(WINDOW, length - windowStart);
+        classify(text + windowStart, windowLength, newlineMask, tabMask, spaceMask, markMask);
+        lineEnd = windowStart + nextBit(newlineMask, 0, windowLength);
+
+        if (lineEnd == windowStart + windowLength && lineEnd < length) {
+            // Longer than a whole window: classify the line on its own
+            const char* newline = static_cast<const char*>(memchr(text + lineEnd, '\n', length - lineEnd));
+            lineEnd = newline ? newline - text : length;
+            size_t words = (lineEnd - position + 63) / 64;
+            vector<uint64_t> lineMasks(words * 4);
+            uint64_t* masks = lineMasks.data();
+            classify(text + position, lineEnd - position, masks, masks + words, masks + 2 * words, masks + 3 * words);
+            walkLine(fields, position, lineEnd, masks + words, masks + 2 * words, masks + 3 * words, position);
+            position = lineEnd + 1;
+            windowLength = 0;
+            return true;
+        }
+    }
+
+    walkLine(fields, position, lineEnd, tabMask, spaceMask, markMask, windowStart);
+    position = lineEnd + 1;
+    return true;
+}
+
+// Stage 2: split the line [begin, end) into fields using the masks, whose
+// bit 0 corresponds to text[maskBase].
+void FieldScanner::walkLine(LineFields& fields, size_t begin, size_t end, const uint64_t* tab,
+                            const uint64_t* space, const uint64_t* mark, size_t maskBase) {
+    fields = LineFields();
+    fields.line = string_view(text + begin, end - begin);
+
+    const char* base = text + maskBase;
+    size_t pos = begin - maskBase;
+    size_t stop = end - maskBase;
+
+    if (nextBit(tab, pos, stop) < stop) {
+        // Tab format: the fields of split(line, '\t')
+        for (int field = 0; field < LineFields::MAX_FIELDS; ++field) {
+            size_t tabPos = nextBit(tab, pos, stop);
+            fields.field[field] = trimField(base + pos, base + tabPos);
+            fields.tail[field] = fields.field[field];
+            fields.count = field + 1;
+            if (tabPos == stop) break;
+            pos = tabPos + 1;
+        }
+        return;
+    }
+
+    // Column format: fields are separated by runs of spaces, a quoted
+    // constant may contain spaces, and a field that starts with '.' opens
+    // a comment running to the end of the line.
+    int field = 0;
+    if (pos < stop && base[pos] == ' ') {
+        fields.count = ++field;
+        pos = nextBit(space, pos, stop, true);
+    }
+    while (pos < stop && field < LineFields::MAX_FIELDS) {
+        fields.tail[field] = trimField(base + pos, base + stop);
+        if (field > 0 && base[pos] == '.') {
+            fields.field[field] = fields.tail[field];
+            fields.commentField = field;
+            fields.count = field + 1;
+            return;
+        }
+
+        size_t fieldEnd = pos;
+        bool quoted = false;
+        while (fieldEnd < stop) {
+            fieldEnd = quoted ? nextBit(mark, fieldEnd, stop)
+                              : min(nextBit(space, fieldEnd, stop), nextBit(mark, fieldEnd, stop));
+            if (fieldEnd == stop || (!quoted && base[fieldEnd] == ' ')) break;
+            if (base[fieldEnd] == '\'') quoted = !quoted;
+            ++fieldEnd;
+        }
+
+        fields.field[field] = trimField(base + pos, base + fieldEnd);
+        fields.count = ++field;
+        pos = nextBit(space, fieldEnd, stop, true);
+    }
+}
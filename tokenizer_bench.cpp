@@ -0,0 +1,139 @@
+// Throughput of the source tokenizer: the stringstream split() path that
+// parseLine used to take versus FieldScanner in each of its modes.
+//
+// Usage: tokenizer_bench [source_file] [megabytes]
+// Without a file, program.asm-style lines are repeated up to the given size.
+
+#include "assembler.h"
+#include <chrono>
+
+namespace {
+
+const char* SAMPLE =
+    "COPY\tSTART\t0\n"
+    "\tEXTDEF\tBUFFER,BUFEND,LENGTH\n"
+    "FIRST\tSTL\tRETADR\n"
+    "CLOOP\t+JSUB\tRDREC\n"
+    "\tLDA\tLENGTH\n"
+    "\tCOMP\t#0\n"
+    ". read the next record\n"
+    "ENDFIL\tLDA\t=C'EOF'\tload end marker\n"
+    "\tJ\t@RETADR\n"
+    "RETADR\tRESW\t1\n"
+    "RLOOP    TD       INPUT\n"
+    "         COMPR    A,S\n"
+    "         +STCH    BUFFER,X       . store char\n"
+    "INPUT    BYTE     X'F1'\n";
+
+string legacyTrim(const string& str) {
+    size_t start = str.find_first_not_of(" \t\r\n");
+    if (start == string::npos) return "";
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(start, end - start + 1);
+}
+
+vector<string> legacySplit(const string& str, char delimiter) {
+    vector<string> tokens;
+    stringstream ss(str);
+    string token;
+    while (getline(ss, token, delimiter)) {
+        tokens.push_back(legacyTrim(token));
+    }
+    return tokens;
+}
+
+// Original parseSourceFile/parseLine tokenizing: getline per line, then
+// split() into freshly allocated strings
+size_t runLegacy(const string& text, size_t& lines) {
+    istringstream input(text);
+    string line;
+    size_t checksum = 0;
+    lines = 0;
+    while (getline(input, line)) {
+        ++lines;
+        if (line.empty() || line[0] == '.') continue;
+        vector<string> parts = legacySplit(line, '\t');
+        for (size_t i = 0; i < parts.size() && i < (size_t)LineFields::MAX_FIELDS; ++i) {
+            checksum += parts[i].length() * (i + 1);
+        }
+    }
+    return checksum;
+}
+
+size_t runScanner(const string& text, FieldScanner::Mode mode, size_t& lines) {
+    FieldScanner scanner(text.data(), text.size(), mode);
+    LineFields fields;
+    size_t checksum = 0;
+    lines = 0;
+    while (scanner.next(fields)) {
+        ++lines;
+        if (fields.line.empty() || fields.line[0] == '.') continue;
+        for (int i = 0; i < fields.count; ++i) {
+            checksum += fields.field[i].length() * (i + 1);
+        }
+    }
+    return checksum;
+}
+
+template <class Fn>
+double timeBest(Fn fn, int repeats) {
+    double best = 1e30;
+    for (int i = 0; i < repeats; ++i) {
+        auto start = chrono::steady_clock::now();
+        fn();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    string text;
+    size_t megabytes = 64;
+    if (argc >= 2) {
+        ifstream file(argv[1], ios::binary);
+        if (!file.is_open()) {
+            cerr << "Error: Cannot open " << argv[1] << endl;
+            return 1;
+        }
+        text.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        if (argc >= 3) megabytes = stoul(argv[2]);
+        string original = text;
+        while (!original.empty() && text.size() < megabytes << 20) text += original;
+    } else {
+        while (text.size() < megabytes << 20) text += SAMPLE;
+    }
+
+    double size = text.size() / 1048576.0;
+    cout << "Input: " << fixed << setprecision(1) << size << " MiB" << endl;
+    cout << left << setw(16) << "Tokenizer" << right << setw(10) << "MiB/s"
+         << setw(14) << "Mlines/s" << setw(10) << "speedup" << endl;
+
+    size_t lines = 0;
+    double legacyTime = timeBest([&] { runLegacy(text, lines); }, 2);
+    cout << left << setw(16) << "split()" << right << setw(10) << setprecision(1) << size / legacyTime
+         << setw(14) << setprecision(2) << lines / legacyTime / 1e6 << setw(9) << "1.0" << "x" << endl;
+
+    const FieldScanner::Mode modes[] = { FieldScanner::SCALAR, FieldScanner::SSE2, FieldScanner::AVX2 };
+    const FieldScanner::Mode* last = modes + 3;
+    size_t expected = 0;
+    for (const FieldScanner::Mode* mode = modes; mode != last; ++mode) {
+        // Modes the CPU lacks fall back to the previous one; don't repeat it
+        string name = string("scanner/") + FieldScanner::modeName(*mode);
+        if (mode != modes && name == string("scanner/") + FieldScanner::modeName(mode[-1])) continue;
+
+        size_t checksum = 0;
+        size_t scannedLines = 0;
+        double elapsed = timeBest([&] { checksum = runScanner(text, *mode, scannedLines); }, 5);
+        cout << left << setw(16) << name << right << setw(10) << setprecision(1) << size / elapsed
+             << setw(14) << setprecision(2) << scannedLines / elapsed / 1e6
+             << setw(9) << setprecision(1) << legacyTime / elapsed << "x";
+        if (scannedLines != lines) cout << "  (line count mismatch!)";
+        if (mode != modes && checksum != expected) cout << "  (field mismatch!)";
+        cout << endl;
+        expected = checksum;
+    }
+    return 0;
+}
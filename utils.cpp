@@ -1,39 +1,63 @@
 #include "assembler.h"
+#include "thread_pool.h"
+#include <climits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Constructor
 SICXEAssembler::SICXEAssembler() {
     currentControlSection = "";
+    currentSection = -1;
+    batchMode = false;
     locationCounter = 0;
     baseRegister = 0;
     baseSet = false;
-    initializeInstructionTable();
+    lineOrigin = nullptr;
+    trace = nullptr;
+    incremental = false;
+    buildCache = nullptr;
+    fromCache = false;
 }
 
 // Utility functions
-string SICXEAssembler::trim(const string& str) {
+string_view SICXEAssembler::trim(string_view str) {
     size_t start = str.find_first_not_of(" \t\r\n");
-    if (start == string::npos) return "";
+    if (start == string_view::npos) return string_view();
     size_t end = str.find_last_not_of(" \t\r\n");
     return str.substr(start, end - start + 1);
 }
 
-vector<string> SICXEAssembler::split(const string& str, char delimiter) {
-    vector<string> tokens;
-    stringstream ss(str);
-    string token;
-    while (getline(ss, token, delimiter)) {
-        tokens.push_back(trim(token));
+// Same tokens getline() would produce: a trailing empty field is dropped
+vector<string_view> SICXEAssembler::split(string_view str, char delimiter) {
+    vector<string_view> tokens;
+    size_t start = 0;
+    while (start < str.length()) {
+        size_t pos = str.find(delimiter, start);
+        if (pos == string_view::npos) {
+            tokens.push_back(trim(str.substr(start)));
+            break;
+        }
+        tokens.push_back(trim(str.substr(start, pos - start)));
+        start = pos + 1;
     }
     return tokens;
 }
 
-string SICXEAssembler::toUpperCase(const string& str) {
-    string result = str;
-    transform(result.begin(), result.end(), result.begin(), ::toupper);
-    return result;
+// Upper-cases a field in place. Fields point into the private, writable
+// mapping of the source file, so this never allocates.
+string_view SICXEAssembler::toUpperCase(string_view field) {
+    char* text = const_cast<char*>(field.data());
+    for (size_t i = 0; i < field.length(); ++i) {
+        if (islower((unsigned char)text[i])) {
+            text[i] = toupper((unsigned char)text[i]);
+        }
+    }
+    return field;
 }
 
-bool SICXEAssembler::isValidSymbol(const string& symbol) {
+bool SICXEAssembler::isValidSymbol(string_view symbol) {
     if (symbol.empty() || symbol.length() > 6) return false;
     if (!isalpha(symbol[0])) return false;
     for (char c : symbol) {
@@ -42,106 +66,303 @@ bool SICXEAssembler::isValidSymbol(const string& symbol) {
     return true;
 }
 
-int SICXEAssembler::hexToDecimal(const string& hex) {
-    int result = 0;
-    stringstream ss;
-    ss << std::hex << hex;
-    ss >> result;
-    return result;
+// Hex codec: digit values and digits come from tables, nothing allocates
+namespace {
+
+const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+struct HexValues {
+    int8_t value[256];
+};
+
+constexpr HexValues buildHexValues() {
+    HexValues table{};
+    for (int c = 0; c < 256; ++c) {
+        table.value[c] = -1;
+    }
+    for (int d = 0; d < 10; ++d) {
+        table.value['0' + d] = d;
+    }
+    for (int d = 0; d < 6; ++d) {
+        table.value['A' + d] = 10 + d;
+        table.value['a' + d] = 10 + d;
+    }
+    return table;
 }
 
-string SICXEAssembler::decimalToHex(int decimal, int width) {
-    stringstream ss;
-    ss << std::hex << std::uppercase << decimal;
-    string result = ss.str();
-    if (width > 0) {
-        while (result.length() < (size_t)width) {
-            result = "0" + result;
-        }
+constexpr HexValues HEX_VALUES = buildHexValues();
+
+inline void encodeHexScalar(const uint8_t* bytes, size_t length, char* out) {
+    for (size_t i = 0; i < length; ++i) {
+        out[2 * i] = HEX_DIGITS[bytes[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[bytes[i] & 0x0F];
     }
-    return result;
 }
 
+#ifdef __SSE2__
+// 16 bytes -> 32 digits: split into nibbles, interleave high/low, then add
+// '0' plus 7 more for the nibbles above 9 ('A' - '9' - 1)
+void encodeHexSSE2(const uint8_t* bytes, size_t length, char* out) {
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letterGap = _mm_set1_epi8('A' - '9' - 1);
+    auto toDigits = [&](__m128i nibbles) {
+        __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, nine), letterGap);
+        return _mm_add_epi8(_mm_add_epi8(nibbles, zero), letters);
+    };
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(data, 4), lowMask);
+        __m128i low = _mm_and_si128(data, lowMask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), toDigits(_mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), toDigits(_mm_unpackhi_epi8(high, low)));
+    }
+    encodeHexScalar(bytes + i, length - i, out + 2 * i);
+}
+#endif
+
+} // namespace
+
+int hexDigitValue(char c) {
+    return HEX_VALUES.value[(unsigned char)c];
+}
+
+// At least 'width' digits, zero-padded; returns the end of what was written
+char* formatHex(char* out, uint32_t value, int width) {
+    int digits = value ? (32 - __builtin_clz(value) + 3) / 4 : 1;
+    digits = max(digits, width);
+    for (int i = digits - 1; i >= 0; --i) {
+        out[i] = HEX_DIGITS[value & 0x0F];
+        value >>= 4;
+    }
+    return out + digits;
+}
+
+// Upper-case hex, two digits per byte; T-record payloads are encoded whole
+void encodeHex(const uint8_t* bytes, size_t length, char* out) {
+#ifdef __SSE2__
+    if (length >= 16) {
+        encodeHexSSE2(bytes, length, out);
+        return;
+    }
+#endif
+    encodeHexScalar(bytes, length, out);
+}
+
+// Eight bytes per step: each word is multiplied in, and the state is
+// rotated and multiplied again; the length and a final avalanche make
+// short inputs and prefixes spread over all 64 bits
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const uint64_t K1 = 0x9E3779B97F4A7C15ULL;
+    const uint64_t K2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed ^ (size * K1);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash ^= word * K2;
+        hash = ((hash << 31) | (hash >> 33)) * K1;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, size - i);
+        hash ^= word * K2;
+        hash = ((hash << 31) | (hash >> 33)) * K1;
+    }
+    hash ^= hash >> 33;
+    hash *= K2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+// Reads like 'stringstream >> hex >> int': leading whitespace, an optional
+// sign and 0x prefix, digits up to the first non-hex character; out-of-range
+// values clamp and text without digits reads as 0
+int SICXEAssembler::hexToDecimal(string_view hex) {
+    size_t pos = 0;
+    while (pos < hex.length() && isspace((unsigned char)hex[pos])) ++pos;
+    bool negative = false;
+    if (pos < hex.length() && (hex[pos] == '+' || hex[pos] == '-')) {
+        negative = hex[pos] == '-';
+        ++pos;
+    }
+    if (pos + 1 < hex.length() && hex[pos] == '0' && (hex[pos + 1] == 'x' || hex[pos + 1] == 'X')) {
+        pos += 2;
+    }
+    
+    long long result = 0;
+    for (; pos < hex.length() && hexDigitValue(hex[pos]) >= 0; ++pos) {
+        result = min(result * 16 + hexDigitValue(hex[pos]), 1LL << 32);
+    }
+    if (negative) {
+        return result > 2147483648LL ? INT_MIN : int(-result);
+    }
+    return result > 2147483647LL ? INT_MAX : int(result);
+}
+
+// Negative values print as their 32-bit two's complement, as ostream does
 string SICXEAssembler::intToHex(int value, int width) {
-    stringstream ss;
-    ss << std::hex << std::uppercase << setfill('0') << setw(width) << value;
-    return ss.str();
+    char digits[16];
+    width = min(width, 16);
+    return string(digits, formatHex(digits, uint32_t(value), width));
+}
+
+string SICXEAssembler::bytesToHex(const uint8_t* bytes, size_t length) {
+    string result(length * 2, '0');
+    encodeHex(bytes, length, &result[0]);
+    return result;
 }
 
 // Parse source file
-void SICXEAssembler::parseSourceFile(const string& filename) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error: Cannot open source file " << filename << endl;
+// Sources larger than PARALLEL_PARSE_MIN are cut into newline-aligned chunks
+// that are tokenized on the thread pool; lines never depend on each other
+// here (pass 1 assigns control sections), so the chunks are simply
+// concatenated in order and their line numbers shifted.
+static const size_t PARALLEL_PARSE_MIN = 1 << 20;
+static const size_t PARSE_CHUNK_MIN = 256 << 10;
+
+void SICXEAssembler::parseSource() {
+    sourceLines.clear();
+    const char* text = source.data();
+    size_t size = source.size();
+    ThreadPool& pool = ThreadPool::shared();
+    
+    if (size < PARALLEL_PARSE_MIN || pool.size() < 2) {
+        parseChunk(text, size, 1, sourceLines);
         return;
     }
     
-    string line;
-    int lineNumber = 1;
-    sourceLines.clear();
+    // Chunk boundaries, each moved forward to just past a newline
+    size_t chunkCount = min(pool.size() * 4, size / PARSE_CHUNK_MIN);
+    vector<size_t> bounds(1, 0);
+    for (size_t i = 1; i < chunkCount; ++i) {
+        size_t pos = max(size * i / chunkCount, bounds.back());
+        const char* newline = static_cast<const char*>(memchr(text + pos, '\n', size - pos));
+        if (!newline) break;
+        bounds.push_back(newline - text + 1);
+    }
+    bounds.push_back(size);
     
-    while (getline(file, line)) {
-        AssemblyLine assemblyLine = parseLine(line, lineNumber);
-        sourceLines.push_back(assemblyLine);
-        lineNumber++;
+    vector<vector<AssemblyLine>> chunks(bounds.size() - 1);
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        parseChunk(text + bounds[i], bounds[i + 1] - bounds[i], 1, chunks[i]);
+    });
+    
+    size_t total = 0;
+    for (const auto& chunk : chunks) total += chunk.size();
+    sourceLines.reserve(total);
+    
+    int lineOffset = 0;
+    for (auto& chunk : chunks) {
+        for (auto& line : chunk) {
+            line.lineNumber += lineOffset;
+            sourceLines.push_back(move(line));
+        }
+        lineOffset += chunk.size();
     }
+}
+
+void SICXEAssembler::parseChunk(const char* text, size_t size, int firstLine, vector<AssemblyLine>& lines) {
+    FieldScanner scanner(text, size);
+    LineFields fields;
+    int lineNumber = firstLine;
     
-    file.close();
+    while (scanner.next(fields)) {
+        lines.push_back(parseLine(fields, lineNumber));
+        lineNumber++;
+    }
 }
 
-AssemblyLine SICXEAssembler::parseLine(const string& line, int lineNum) {
+AssemblyLine SICXEAssembler::parseLine(const LineFields& fields, int lineNum) {
     AssemblyLine assemblyLine;
     assemblyLine.lineNumber = lineNum;
     assemblyLine.controlSection = currentControlSection;
     
     // Check for comment line
-    if (line.empty() || line[0] == '.') {
+    if (fields.line.empty() || fields.line[0] == '.') {
         assemblyLine.isComment = true;
-        assemblyLine.comment = line;
+        assemblyLine.comment = fields.line;
         return assemblyLine;
     }
     
-    // Parse the line (assuming tab-separated format)
-    vector<string> parts = split(line, '\t');
+    // Fields past the start of an inline comment are part of the comment
+    auto field = [&fields](int index) {
+        return index < fields.commentField ? fields.field[index] : string_view();
+    };
+    auto commentFrom = [&fields](int index) {
+        return fields.tail[min(index, fields.commentField)];
+    };
     
-    if (parts.size() >= 1) {
+    if (fields.count >= 1) {
         // Check if first part is a label or opcode
-        string firstPart = toUpperCase(trim(parts[0]));
+        // (USE is only recognized in the opcode column)
+        string_view firstPart = toUpperCase(fields.field[0]);
+        const Instruction* leading = findInstruction(firstPart);
         
-        if (instructionTable.find(firstPart) != instructionTable.end() || 
-            firstPart == "START" || firstPart == "END" || firstPart == "RESW" || 
-            firstPart == "RESB" || firstPart == "WORD" || firstPart == "BYTE" ||
-            firstPart == "CSECT" || firstPart == "EXTDEF" || firstPart == "EXTREF" ||
-            firstPart == "BASE" || firstPart == "NOBASE" || firstPart == "EQU" ||
-            firstPart == "ORG" || firstPart == "LTORG") {
+        if (leading && leading->code != Opcode::USE) {
             // First part is opcode
             assemblyLine.opcode = firstPart;
-            if (parts.size() >= 2) {
-                assemblyLine.operand = trim(parts[1]);
-            }
-            if (parts.size() >= 3) {
-                assemblyLine.comment = trim(parts[2]);
-            }
+            assemblyLine.operand = field(1);
+            assemblyLine.comment = commentFrom(2);
         } else {
             // First part is label
             assemblyLine.label = firstPart;
-            if (parts.size() >= 2) {
-                assemblyLine.opcode = toUpperCase(trim(parts[1]));
-            }
-            if (parts.size() >= 3) {
-                assemblyLine.operand = trim(parts[2]);
-            }
-            if (parts.size() >= 4) {
-                assemblyLine.comment = trim(parts[3]);
-            }
+            assemblyLine.opcode = toUpperCase(field(1));
+            assemblyLine.operand = field(2);
+            assemblyLine.comment = commentFrom(3);
         }
+        decodeOpcode(assemblyLine);
     }
     
     return assemblyLine;
 }
 
-bool SICXEAssembler::isRegisterName(const string& name) {
-    // SIC/XE register names
-    return (name == "A" || name == "X" || name == "L" || name == "B" || 
-            name == "S" || name == "T" || name == "F" || name == "PC" || name == "SW");
+bool SICXEAssembler::isRegisterName(string_view name) {
+    return registerNumber(name) >= 0;
+}
+
+// SIC/XE register number for format 2 operands, -1 if not a register
+int SICXEAssembler::registerNumber(string_view name) {
+    if (name.length() == 1) {
+        switch (name[0]) {
+            case 'A': return 0;
+            case 'X': return 1;
+            case 'L': return 2;
+            case 'B': return 3;
+            case 'S': return 4;
+            case 'T': return 5;
+            case 'F': return 6;
+            default: return -1;
+        }
+    }
+    if (name == "PC") return 8;
+    if (name == "SW") return 9;
+    return -1;
+}
+
+// Accepts exactly what stoi() accepts (leading whitespace, optional sign,
+// at least one digit, trailing text ignored, int range) without throwing
+bool SICXEAssembler::parseDecimal(string_view text, int& value) {
+    size_t pos = 0;
+    while (pos < text.length() && isspace((unsigned char)text[pos])) ++pos;
+    bool negative = false;
+    if (pos < text.length() && (text[pos] == '+' || text[pos] == '-')) {
+        negative = text[pos] == '-';
+        ++pos;
+    }
+    if (pos == text.length() || !isdigit((unsigned char)text[pos])) return false;
+    
+    long long result = 0;
+    for (; pos < text.length() && isdigit((unsigned char)text[pos]); ++pos) {
+        result = result * 10 + (text[pos] - '0');
+        if (result > 2147483648LL) return false;
+    }
+    if (negative) result = -result;
+    if (result > 2147483647LL) return false;
+    value = (int)result;
+    return true;
 }